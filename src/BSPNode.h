@@ -4,100 +4,105 @@
 
 #include "types.h"
 
-class CBSPNode;
-using ptr_bspnode_t = std::shared_ptr<CBSPNode>;
-
 // ================================ BSP Node Class ================================
 /**
- * @brief Binary Space Partitioning (BSP) node class
+ * @brief Compact Binary Space Partitioning (BSP) node class
+ * @details The node occupies 8 bytes. The nodes of a tree are stored in one array in depth-first order (Ref. CBSPTree),
+ * thus the left child of a branch node immediately follows its parent and only the index of the right child is stored.
+ * A leaf node refers to its primitives as a range in the shared array of primitive indices of the tree.
+ * An unbuilt node stands for a sub-tree, which is not split yet, and refers to its pending record (Ref. CBSPTree::build() with lazy flag).
  */
 class CBSPNode
 {
 public:
 	/**
 	 * @brief Leaf node constructor
-	 * @param vpPrims The vector of pointers to the primitives included in the leaf node
+	 * @param primOffset The index of the first primitive reference of the leaf in the shared array of the tree
+	 * @param nPrims The number of primitives included in the leaf node
 	 */
-	CBSPNode(const std::vector<ptr_prim_t>& vpPrims)
-		: CBSPNode(vpPrims, 0, 0, nullptr, nullptr)
+	CBSPNode(dword primOffset, dword nPrims)
+		: m_primOffset(primOffset)
+		, m_flags((nPrims << 3) | 3)
 	{}
 	/**
 	 * @brief Branch node constructor
 	 * @param splitDim The splitting dimension
 	 * @param splitVal The splitting value
-	 * @param left Pointer to the left sub-tree
-	 * @param right Pointer to the right sub-tree
+	 * @param right The index of the right child. The left child is the next node after the branch node
 	 */
-	CBSPNode(int splitDim, float splitVal, ptr_bspnode_t left, ptr_bspnode_t right)
-		: CBSPNode(std::nullopt, splitDim, splitVal, left, right)
+	CBSPNode(int splitDim, float splitVal, dword right)
+		: m_splitVal(splitVal)
+		, m_flags((right << 2) | static_cast<dword>(splitDim))
 	{}
-	CBSPNode(const CBSPNode&) = delete;
-	virtual ~CBSPNode(void) = default;
-	const CBSPNode& operator=(const CBSPNode&) = delete;
+	~CBSPNode(void) = default;
 
 	/**
-	 * @brief Traverses the ray \b ray and checks for intersection with a primitive
-	 * @details If the intersection is found, \b ray.t is updated
-	 * @param[in,out] ray The ray
-	 * @param[in] t0 The distance from ray origin at which the ray enters the scene
-	 * @param[in] t1 The distance from ray origin at which the ray leaves the scene
-	 * @retval true If ray \b ray intersects any object
-	 * @retval false otherwise
+	 * @brief Creates an unbuilt node
+	 * @param subtree The index of the pending sub-tree record of the node
+	 * @returns The unbuilt node
 	 */
-	bool intersect(Ray& ray, double t0, double t1) const
+	static CBSPNode unbuilt(dword subtree)
 	{
-		if (isLeaf()) {
-			// --- PUT YOUR CODE HERE ---
-			return false;
-		} else {
-			// --- PUT YOUR CODE HERE ---
-			return false;
-		}
+		CBSPNode res(subtree, 0);
+		res.m_flags |= 4;
+		return res;
 	}
 
 	/**
-	 * @brief Returns the pointer to the \a left child
-	 * @returns The pointer to the root-node of the \a left sub-tree
+	 * @brief Returns the index of the \a right child
+	 * @returns The index of the root-node of the \a right sub-tree
 	 */
-	ptr_bspnode_t Left(void) const { return m_pLeft; }
+	dword Right(void) const { return m_flags >> 2; }
 	/**
-	 * @brief Returns the pointer to the \a right child
-	 * @returns The pointer to the root-node of the \a right sub-tree
+	 * @brief Returns the splitting dimension of the branch node
+	 * @returns The splitting dimension: 0 is x, 1 is y and 2 is z
 	 */
-	ptr_bspnode_t Right(void) const { return m_pRight; }
-
-	
-private:
+	int getSplitDim(void) const { return static_cast<int>(m_flags & 3); }
 	/**
-	 * @brief Genereal private constructor
-	 * @details This constructor may contruct both types of the nodes (leaf and branch) and is to be called from public leaf- and branch-node contructors
-	 * @param vpPrims The vector of pointers to the primitives included in the leaf node
-	 * @param splitDim The splitting dimension
-	 * @param splitVal The splitting value
-	 * @param left Pointer to the left sub-tree
-	 * @param right Pointer to the right sub-tree
+	 * @brief Returns the splitting value of the branch node
+	 * @returns The position of the splitting plane in the splitting dimension
 	 */
-	CBSPNode(std::optional<std::vector<ptr_prim_t>> vpPrims, int splitDim, float splitVal, ptr_bspnode_t left, ptr_bspnode_t right)
-		: m_vpPrims(vpPrims.value_or(std::vector<ptr_prim_t>()))
-		, m_splitDim(splitDim)
-		, m_splitVal(splitVal)
-		, m_pLeft(left)
-		, m_pRight(right)
-	{}
-
+	float getSplitVal(void) const { return m_splitVal; }
+	/**
+	 * @brief Returns the index of the first primitive reference of the leaf node
+	 * @returns The offset of the primitive references of the leaf in the shared array of the tree
+	 */
+	dword getPrimOffset(void) const { return m_primOffset; }
+	/**
+	 * @brief Returns the number of primitives included in the leaf node
+	 * @returns The number of primitives
+	 */
+	dword getNumPrims(void) const { return m_flags >> 3; }
+	/**
+	 * @brief Returns the index of the pending sub-tree record of the unbuilt node
+	 * @returns The index of the record
+	 */
+	dword getSubtree(void) const { return m_primOffset; }
 	/**
 	 * @brief Checks whether the node is either leaf or branch node
 	 * @retval true if the node is the leaf-node
 	 * @retval false if the node is a branch-node
 	 */
-	bool isLeaf(void) const { return (!m_pLeft && !m_pRight); }
-	
-	
+	bool isLeaf(void) const { return (m_flags & 3) == 3; }
+	/**
+	 * @brief Checks whether the leaf node is an unbuilt sub-tree
+	 * @retval true if the node stands for a sub-tree, which is not split yet
+	 * @retval false if the node is a regular leaf-node
+	 */
+	bool isUnbuilt(void) const { return (m_flags & 7) == 7; }
+
+
+public:
+	static constexpr dword maxIndex = 0x3FFFFFFF;		///< The maximum index of the right child
+	static constexpr dword maxPrims = 0x1FFFFFFF;		///< The maximum number of primitives in a leaf
+
+
 private:
-	std::vector<ptr_prim_t>	m_vpPrims;		///< The vector of pointers to the primitives included in the leaf node
-	int 					m_splitDim;		///< The splitting dimension
-	float 					m_splitVal;		///< The splitting value
-	ptr_bspnode_t 	        m_pLeft;		///< Pointer to the left sub-tree
-	ptr_bspnode_t 	        m_pRight;		///< Pointer to the right sub-tree
+	union {
+		float	m_splitVal;		///< The splitting value (branch nodes only)
+		dword	m_primOffset;	///< The offset of the primitive references or the index of the pending sub-tree (leaf nodes only)
+	};
+	dword		m_flags;		///< Bits 0-1: the splitting dimension or 3 for a leaf; bits 2-31: the index of the right child; for a leaf bit 2 marks an unbuilt node and bits 3-31 hold the number of primitives
 };
 
+static_assert(sizeof(CBSPNode) == 8, "The BSP node must be 8 bytes");
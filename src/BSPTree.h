@@ -4,13 +4,44 @@
 #include "BoundingBox.h"
 #include "IPrim.h"
 #include "ray.h"
+#include "Frustum.h"
+#include "Tracer.h"
+#include <atomic>
+#include <mutex>
 
 namespace {
-	// Calculates and return the bounding box, containing the whole scene
-	CBoundingBox calcBoundingBox(const std::vector<ptr_prim_t>& vpPrims)
+	// Returns the minimum of n values
+	float reduceMin(const float* p, size_t n)
 	{
-		CBoundingBox res;
-		// --- PUT YOUR CODE HERE ---
+		float res = Infty;
+		size_t i = 0;
+#ifdef VEC3FA_SSE
+		__m128 m = _mm_set1_ps(Infty);
+		for (; i + 4 <= n; i += 4)
+			m = _mm_min_ps(m, _mm_loadu_ps(p + i));
+		m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+		m = _mm_min_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+		res = _mm_cvtss_f32(m);
+#endif
+		for (; i < n; i++) res = MIN(res, p[i]);
+		return res;
+	}
+
+	// Returns the maximum of n values
+	float reduceMax(const float* p, size_t n)
+	{
+		float res = -Infty;
+		size_t i = 0;
+#ifdef VEC3FA_SSE
+		__m128 m = _mm_set1_ps(-Infty);
+		for (; i + 4 <= n; i += 4)
+			m = _mm_max_ps(m, _mm_loadu_ps(p + i));
+		m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+		m = _mm_max_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+		res = _mm_cvtss_f32(m);
+#endif
+		for (; i < n; i++) res = MAX(res, p[i]);
+		return res;
 	}
 
 	// Returns the best dimension index for next split
@@ -20,9 +51,132 @@ namespace {
 	}
 }
 
+/**
+ * @brief Bounding boxes and centroids of the primitives in the structure-of-arrays layout
+ * @details They are gathered once per build with one virtual call per primitive. The build then reads only the coordinates
+ * of the splitting dimension, which lie contiguously in memory
+ */
+struct BSPPrimBounds
+{
+	std::array<std::vector<float>, 3>	vMin;			///< The minimal points of the bounding boxes, per dimension
+	std::array<std::vector<float>, 3>	vMax;			///< The maximal points of the bounding boxes, per dimension
+	std::array<std::vector<float>, 3>	vCentroid;		///< The centers of the bounding boxes, per dimension
+
+	/**
+	 * @brief Gathers the bounding boxes and the centroids of the primitives in parallel
+	 * @param vpPrims The primitives
+	 */
+	void gather(const std::vector<ptr_prim_t>& vpPrims)
+	{
+		for (int d = 0; d < 3; d++) {
+			vMin[d].resize(vpPrims.size());
+			vMax[d].resize(vpPrims.size());
+			vCentroid[d].resize(vpPrims.size());
+		}
+		parallel_for_(Range(0, static_cast<int>(vpPrims.size())), [&](const Range& range) {
+			for (int i = range.start; i < range.end; i++) {
+				CBoundingBox box = vpPrims[i]->getBoundingBox();
+				for (int d = 0; d < 3; d++) {
+					vMin[d][i] = box.getMinPoint().val[d];
+					vMax[d][i] = box.getMaxPoint().val[d];
+					vCentroid[d][i] = 0.5f * (vMin[d][i] + vMax[d][i]);
+				}
+			}
+		});
+	}
+	/**
+	 * @brief Calculates the bounding box of all the primitives
+	 * @details The chunks of the arrays are reduced in parallel, 4 values at once with SSE
+	 * @returns The bounding box, containing all the primitives
+	 */
+	CBoundingBox calcBoundingBox(void) const
+	{
+		const size_t chunkSize = 16384;
+		const size_t nChunks = (size() + chunkSize - 1) / chunkSize;
+		std::vector<CBoundingBox> vBoxes(nChunks);
+		parallel_for_(Range(0, static_cast<int>(nChunks)), [&](const Range& range) {
+			for (int c = range.start; c < range.end; c++) {
+				size_t begin = c * chunkSize;
+				size_t n = MIN(chunkSize, size() - begin);
+				Vec3fa minPoint, maxPoint;
+				for (int d = 0; d < 3; d++) {
+					minPoint.val[d] = reduceMin(vMin[d].data() + begin, n);
+					maxPoint.val[d] = reduceMax(vMax[d].data() + begin, n);
+				}
+				vBoxes[c] = CBoundingBox(minPoint, maxPoint);
+			}
+		});
+		CBoundingBox res;
+		for (const auto& box : vBoxes)
+			res.extend(box);
+		return res;
+	}
+	/**
+	 * @brief Checks whether the bounding box of the primitive lies inside the bounding box \b box in all the dimensions but one
+	 * @param i The index of the primitive
+	 * @param box The bounding box
+	 * @param skipDim The dimension, which is not checked
+	 * @retval true If the bounding box of primitive \b i lies inside \b box in the dimensions other than \b skipDim
+	 * @retval false Otherwise
+	 */
+	bool isInside(size_t i, const CBoundingBox& box, int skipDim) const
+	{
+		for (int d = 0; d < 3; d++)
+			if (d != skipDim && (vMin[d][i] < box.getMinPoint().val[d] || vMax[d][i] > box.getMaxPoint().val[d])) return false;
+		return true;
+	}
+	/**
+	 * @brief Returns the number of primitives
+	 * @returns The number of primitives
+	 */
+	size_t size(void) const { return vMin[0].size(); }
+	/**
+	 * @brief Returns the memory occupied by the arrays
+	 * @returns The size of the arrays in bytes
+	 */
+	size_t getMemoryUsage(void) const { return 9 * size() * sizeof(float); }
+};
+
+struct BSPSubtree;
+
+/// Part of the BSP tree, built at once. The nodes refer to each other and to the primitive references by the indices within the chunk
+struct BSPChunk
+{
+	std::vector<CBSPNode>						vNodes;			///< The nodes of the chunk in depth-first order; the root is the first one
+	std::vector<dword>							vPrimIdx;		///< The primitive references of all the leaves
+	std::vector<std::unique_ptr<BSPSubtree>>	vpSubtrees;		///< The pending sub-trees of the unbuilt nodes
+};
+
+/// Sub-tree, which is split only when a ray enters it for the first time (Ref. CBSPNode::unbuilt())
+struct BSPSubtree
+{
+	BSPSubtree(const CBoundingBox& box, std::vector<dword>&& vIdx, size_t depth) : box(box), vIdx(std::move(vIdx)), depth(depth) {}
+	~BSPSubtree(void) { delete pChunk.load(std::memory_order_relaxed); }
+
+	CBoundingBox				box;					///< The region of the sub-tree
+	std::vector<dword>			vIdx;					///< The indices of the primitives, overlapping the region. They are released after the expansion
+	size_t						depth;					///< The depth of the sub-tree root
+	std::once_flag				built;					///< Guards the expansion
+	std::atomic<BSPChunk*>		pChunk{ nullptr };		///< The built chunk of the sub-tree or nullptr, if the sub-tree is not expanded yet
+};
+
+/// Traversal entry point of the BSP tree for a beam of rays (Ref. CBSPTree::findEntry())
+struct BSPEntry
+{
+	const BSPChunk*	pChunk = nullptr;	///< The chunk of the entry node or nullptr if the beam misses the whole tree
+	size_t			node = 0;			///< The index of the entry node within the chunk
+	CBoundingBox	box;				///< The region of the entry node
+};
+
 // ================================ BSP Tree Class ================================
 /**
  * @brief Binary Space Partitioning (BSP) tree class
+ * @details The tree is stored compactly: the 8-byte nodes (Ref. CBSPNode) lie in one array and the leaves refer to
+ * ranges of one shared array of 32-bit primitive indices.
+ * The tree may also be built lazily: then a sub-tree is split only when a ray enters it for the first time. Such sub-tree is
+ * represented by an unbuilt node, which keeps the list of its primitives. The first ray, which reaches the node, builds the next
+ * few levels below it as a separate chunk (Ref. BSPChunk) and publishes it atomically; the concurrent rays wait for the
+ * expansion to finish. The published chunks are never modified, thus traversal needs no locks
  */
 class CBSPTree
 {
@@ -37,15 +191,72 @@ public:
 	 * @param vpPrims The vector of pointers to the primitives in the scene
 	 * @param maxDepth The maximum allowed depth of the tree.
 	 * Increasing the depth of the tree may speed-up rendering, but increse the memory consumption.
+	 * The depth is limited by the size of the traversal stack (Ref. maxStackDepth). Zero value derives the depth from the primitives (Ref. estimateParams())
 	 * @param minPrimitives The minimum number of primitives in a leaf-node.
-	 * This parameters should be alway above 1.
+	 * This parameters should be alway above 1. Zero value derives the number from the primitives (Ref. estimateParams())
+	 * @param lazy The flag indicating whether the sub-trees should be split on demand, i.e. when the rays enter them for the first time
 	 */
-	void build(const std::vector<ptr_prim_t>& vpPrims, size_t maxDepth = 20, size_t minPrimitives = 3) {
-		m_treeBoundingBox = calcBoundingBox(vpPrims);
-		m_maxDepth = maxDepth;
+	void build(const std::vector<ptr_prim_t>& vpPrims, size_t maxDepth = 20, size_t minPrimitives = 3, bool lazy = false) {
+		m_primBounds.gather(vpPrims);
+		m_treeBoundingBox = m_primBounds.calcBoundingBox();
+		if (maxDepth == 0 || minPrimitives == 0) {
+			auto params = estimateParams();
+			if (maxDepth == 0) maxDepth = params.first;
+			if (minPrimitives == 0) minPrimitives = params.second;
+		}
+		m_maxDepth = MIN(maxDepth, maxStackDepth);
 		m_minPrimitives = minPrimitives;
-		std::cout << "Scene bounds are : " << m_treeBoundingBox << std::endl;
-		m_root = build(m_treeBoundingBox, vpPrims, 0);
+		m_lazy = lazy;
+		m_vpPrims = vpPrims;
+		m_root = BSPChunk();
+
+		std::vector<dword> vIdx(m_vpPrims.size());
+		for (size_t i = 0; i < vIdx.size(); i++) vIdx[i] = static_cast<dword>(i);
+		build(m_root, m_treeBoundingBox, std::move(vIdx), 0, lazy ? 0 : m_maxDepth);
+		if (!lazy) m_primBounds = BSPPrimBounds();		// the unbuilt sub-trees will need the bounds later
+	}
+	/**
+	 * @brief Returns the bounding box of the tree
+	 * @returns The bounding box, containing all the primitives of the tree
+	 */
+	CBoundingBox getBoundingBox(void) const { return m_treeBoundingBox; }
+	/**
+	 * @brief Returns the maximum depth of the tree
+	 * @returns The maximum depth, the tree was built with, or zero if the tree is not built yet
+	 */
+	size_t getMaxDepth(void) const { return m_maxDepth; }
+	/**
+	 * @brief Returns the minimum number of primitives in a leaf-node
+	 * @returns The minimum number of primitives, the tree was built with, or zero if the tree is not built yet
+	 */
+	size_t getMinPrimitives(void) const { return m_minPrimitives; }
+	/**
+	 * @brief Checks whether the tree was built lazily
+	 * @retval true If the sub-trees are split on demand
+	 * @retval false Otherwise
+	 */
+	bool isLazy(void) const { return m_lazy; }
+	/**
+	 * @brief Returns the number of nodes of the tree
+	 * @note If the tree is built lazily, only the nodes built so far are counted. The rendering threads must be idle
+	 * @returns The number of leaf, branch and unbuilt nodes
+	 */
+	size_t getNumNodes(void) const { return getNumNodes(m_root); }
+	/**
+	 * @brief Returns the memory occupied by the tree
+	 * @note If the tree is built lazily, only the nodes built so far are counted. The rendering threads must be idle
+	 * @returns The size of the nodes, of the primitive references, of the pending sub-trees, of the primitive pointers
+	 * and of the primitive bounds, kept for the lazy build, in bytes
+	 */
+	size_t getMemoryUsage(void) const { return getMemoryUsage(m_root) + m_vpPrims.size() * sizeof(ptr_prim_t) + m_primBounds.getMemoryUsage(); }
+	/**
+	 * @brief Returns the effective duplication factor of the primitives
+	 * @note If the tree is built lazily, the unbuilt sub-trees count with their pending primitive lists. The rendering threads must be idle
+	 * @returns The average number of leaves, referencing a primitive
+	 */
+	double getDuplicationFactor(void) const
+	{
+		return m_vpPrims.empty() ? 0 : static_cast<double>(getNumPrimRefs(m_root)) / m_vpPrims.size();
 	}
 	/**
 	 * @brief Checks whether the ray \b ray intersects a primitive.
@@ -54,24 +265,102 @@ public:
 	 */
 	bool intersect(Ray& ray) const
 	{
-		// --- PUT YOUR CODE HERE ---
-		return false;
+		if (m_root.vNodes.empty()) return false;
+		float t0 = 0;
+		float t1 = ray.t;
+		m_treeBoundingBox.clip(ray, t0, t1);
+		if (t1 < t0) return false;
+		float t = ray.t;
+		intersect(ray, &m_root, 0, t0, t1);
+		return ray.t < t;
+	}
+	/**
+	 * @brief Finds the traversal entry point for a beam of rays
+	 * @details Descends the tree, while the beam \b frustum overlaps only one child of the current node.
+	 * The resulting node is the deepest node, whose region contains all the parts of the tree, which may be hit by the rays of the beam.
+	 * Traversal of every ray of the beam may start in that node instead of the root (Ref. intersect(Ray&, const BSPEntry&)).
+	 * The unbuilt sub-trees on the way are expanded.
+	 * @param frustum The frustum of the beam
+	 * @returns The traversal entry point
+	 */
+	BSPEntry findEntry(const CFrustum& frustum) const
+	{
+		BSPEntry res;
+		if (m_root.vNodes.empty() || !frustum.overlaps(m_treeBoundingBox)) return res;
+
+		res.pChunk = &m_root;
+		res.box = m_treeBoundingBox;
+		for (;;) {
+			const CBSPNode& node = res.pChunk->vNodes[res.node];
+			if (node.isUnbuilt()) {
+				res.pChunk = &expand(*res.pChunk->vpSubtrees[node.getSubtree()]);
+				res.node = 0;
+				continue;
+			}
+			if (node.isLeaf()) break;
+			auto splitBoxes = res.box.split(node.getSplitDim(), node.getSplitVal());
+			bool left = frustum.overlaps(splitBoxes.first);
+			bool right = frustum.overlaps(splitBoxes.second);
+			if (left && right) break;
+			if (!left && !right) return BSPEntry();
+			res.node = left ? res.node + 1 : node.Right();
+			res.box = left ? splitBoxes.first : splitBoxes.second;
+		}
+		return res;
+	}
+	/**
+	 * @brief Checks whether the ray \b ray of a beam intersects a primitive.
+	 * @details The traversal starts at the entry point of the beam. If ray \b ray intersects a primitive, the \b ray.t value will be updated
+	 * @param[in,out] ray The ray, belonging to the beam
+	 * @param entry The traversal entry point of the beam (Ref. findEntry())
+	 */
+	bool intersect(Ray& ray, const BSPEntry& entry) const
+	{
+		if (!entry.pChunk) return false;
+		float t0 = 0;
+		float t1 = ray.t;
+		entry.box.clip(ray, t0, t1);
+		if (t1 < t0) return false;
+		float t = ray.t;
+		intersect(ray, entry.pChunk, entry.node, t0, t1);
+		return ray.t < t;
 	}
 
 
+public:
+	static constexpr size_t maxStackDepth = 64;	///< The maximum depth of the tree, limited by the size of the traversal stack
+
+
 private:
 	/**
 	 * @brief Builds the BSP tree
-	 * @details This function builds the BSP tree recursively
+	 * @details This function builds the BSP tree recursively, appending the nodes to chunk \b chunk in depth-first order
+	 * @param chunk The chunk, the nodes are appended to
 	 * @param box The bounding box containing all the scene primitives
-	 * @param vpPrims The vector of pointers to the primitives included in the bounding box \b box
+	 * @param vIdx The indices of the primitives included in the bounding box \b box
 	 * @param depth The distance from the root node of the tree
+	 * @param lazyDepth The depth, at which the sub-trees are left unbuilt. If it is not less than the maximum depth, the whole sub-tree is built
+	 * @returns The index of the created node
 	 */
-	ptr_bspnode_t build(const CBoundingBox& box, const std::vector<ptr_prim_t>& vpPrims, size_t depth)
+	dword build(BSPChunk& chunk, const CBoundingBox& box, std::vector<dword>&& vIdx, size_t depth, size_t lazyDepth) const
 	{
+		TRACE_SCOPE_ARG(depth < m_maxTraceDepth ? "BSP level" : nullptr, "depth", static_cast<int64>(depth));
+		dword res = static_cast<dword>(chunk.vNodes.size());
+
 		// Check for stoppong criteria
-		if (depth >= m_maxDepth || vpPrims.size() <= m_minPrimitives)
-			return std::make_shared<CBSPNode>(vpPrims);                                     // => Create a leaf node and break recursion
+		if (depth >= m_maxDepth || vIdx.size() <= m_minPrimitives) {
+			// => Create a leaf node and break recursion
+			CV_Assert(vIdx.size() <= CBSPNode::maxPrims);
+			chunk.vNodes.emplace_back(static_cast<dword>(chunk.vPrimIdx.size()), static_cast<dword>(vIdx.size()));
+			chunk.vPrimIdx.insert(chunk.vPrimIdx.end(), vIdx.begin(), vIdx.end());
+			return res;
+		}
+		if (depth >= lazyDepth) {
+			// => Postpone splitting until a ray enters the sub-tree
+			chunk.vNodes.push_back(CBSPNode::unbuilt(static_cast<dword>(chunk.vpSubtrees.size())));
+			chunk.vpSubtrees.push_back(std::make_unique<BSPSubtree>(box, std::move(vIdx), depth));
+			return res;
+		}
 
 		// else -> prepare for creating a branch node
 		// First split the bounding volume into two halfes
@@ -81,28 +370,212 @@ private:
 		CBoundingBox& lBox = splitBoxes.first;
 		CBoundingBox& rBox = splitBoxes.second;
 
-		// Second order the primitives into new nounding boxes
-		std::vector<ptr_prim_t> lPrim;
-		std::vector<ptr_prim_t> rPrim;
-		for (auto pPrim : vpPrims) {
-			if (pPrim->getBoundingBox().overlaps(lBox))
-				lPrim.push_back(pPrim);
-			if (pPrim->getBoundingBox().overlaps(rBox))
-				rPrim.push_back(pPrim);
+		// Second order the primitives into new nounding boxes. The primitives, straddling the splitting plane, are clipped
+		// to the current box first, thus a primitive is referenced only by the children, which it really overlaps.
+		// If the bounding box of a primitive lies inside the current box in the two other dimensions, the clipped primitive
+		// still spans the splitting plane (the primitive is convex), thus the clipping is skipped for it
+		std::vector<dword> lIdx;
+		std::vector<dword> rIdx;
+		const std::vector<float>& vMin = m_primBounds.vMin[splitDim];
+		const std::vector<float>& vMax = m_primBounds.vMax[splitDim];
+		for (dword i : vIdx) {
+			float primMin = vMin[i];
+			float primMax = vMax[i];
+			if (primMin <= splitVal && primMax >= splitVal && !m_primBounds.isInside(i, box, splitDim)) {
+				CBoundingBox primBox = m_vpPrims[i]->getClippedBoundingBox(box);
+				if (primBox.isEmpty()) continue;
+				primMin = primBox.getMinPoint().val[splitDim];
+				primMax = primBox.getMaxPoint().val[splitDim];
+			}
+			if (primMin <= splitVal)
+				lIdx.push_back(i);
+			if (primMax >= splitVal)
+				rIdx.push_back(i);
+		}
+
+		// Next build recursively 2 subtrees for both halfes: the left one immediately follows the branch node
+		chunk.vNodes.emplace_back(splitDim, splitVal, 0);
+		vIdx = std::vector<dword>();
+		build(chunk, lBox, std::move(lIdx), depth + 1, lazyDepth);
+		dword right = build(chunk, rBox, std::move(rIdx), depth + 1, lazyDepth);
+		CV_Assert(right <= CBSPNode::maxIndex && chunk.vPrimIdx.size() <= std::numeric_limits<dword>::max());
+		chunk.vNodes[res] = CBSPNode(splitDim, splitVal, right);
+
+		return res;
+	}
+
+	/**
+	 * @brief Derives the build parameters from the number and the distribution of the primitives
+	 * @details The leaves grow slowly with the number of primitives. The centroids of the primitives are binned into a grid of
+	 * up to 16 cubic cells along the widest dimension of the tree bounding box. The tree needs about log2 of the number of cells
+	 * levels to cut off the empty cells, and then the levels to divide the mean population of the occupied cells into the leaves.
+	 * A few levels more compensate for the straddling primitives and for the unbalanced midpoint splits.
+	 * Thus a clustered scene gets a deeper tree than a scene of the same size, which fills its bounding box evenly
+	 * @returns The maximum depth of the tree and the minimum number of primitives in a leaf-node
+	 */
+	std::pair<size_t, size_t> estimateParams(void) const
+	{
+		const size_t nPrims = m_primBounds.size();
+		const size_t minPrimitives = static_cast<size_t>(MAX(2.0, MIN(4.0, std::round(std::log2(MAX(static_cast<double>(nPrims), 1.0)) / 6))));
+		if (nPrims <= minPrimitives) return std::make_pair(size_t(1), minPrimitives);
+
+		const Vec3fa extent = m_treeBoundingBox.getMaxPoint() - m_treeBoundingBox.getMinPoint();
+		const float cellSize = MAX(MAX(extent.val[0], extent.val[1]), extent.val[2]) / 16;
+		if (cellSize <= 0) return std::make_pair(size_t(1), minPrimitives);
+		int res[3];
+		for (int d = 0; d < 3; d++)
+			res[d] = MAX(1, MIN(16, static_cast<int>(std::ceil(extent.val[d] / cellSize))));
+		std::vector<byte> vOccupied(res[0] * res[1] * res[2], 0);
+		for (size_t i = 0; i < nPrims; i++) {
+			int cell = 0;
+			for (int d = 2; d >= 0; d--) {
+				int c = static_cast<int>((m_primBounds.vCentroid[d][i] - m_treeBoundingBox.getMinPoint().val[d]) / cellSize);
+				cell = cell * res[d] + MAX(0, MIN(res[d] - 1, c));
+			}
+			vOccupied[cell] = 1;
 		}
+		const size_t nOccupied = std::count(vOccupied.begin(), vOccupied.end(), 1);
 
-		// Next build recursively 2 subtrees for both halfes
-		auto pLeft = build(lBox, lPrim, depth + 1);
-		auto pRight = build(rBox, rPrim, depth + 1);
+		const double gridLevels = std::log2(static_cast<double>(vOccupied.size()));
+		const double cellLevels = std::log2(MAX(1.0, static_cast<double>(nPrims) / (nOccupied * minPrimitives)));
+		const size_t maxDepth = static_cast<size_t>(std::round(gridLevels + cellLevels)) + 3;
+		return std::make_pair(MIN(maxDepth, maxStackDepth), minPrimitives);
+	}
+
+	/**
+	 * @brief Returns the chunk of the sub-tree \b subtree, building it if necessary
+	 * @details The first calling thread splits the next few levels (Ref. m_lazyLevels) of the sub-tree, while the concurrent threads wait.
+	 * Afterwards the chunk is read with one acquire load
+	 * @param subtree The pending sub-tree of an unbuilt node
+	 * @returns The chunk of the sub-tree
+	 */
+	const BSPChunk& expand(BSPSubtree& subtree) const
+	{
+		const BSPChunk* pChunk = subtree.pChunk.load(std::memory_order_acquire);
+		if (pChunk) return *pChunk;
+		std::call_once(subtree.built, [&] {
+			TRACE_SCOPE_ARG("BSP expand", "depth", static_cast<int64>(subtree.depth));
+			auto pNewChunk = std::make_unique<BSPChunk>();
+			build(*pNewChunk, subtree.box, std::move(subtree.vIdx), subtree.depth, subtree.depth + m_lazyLevels);
+			subtree.vIdx = std::vector<dword>();
+			subtree.pChunk.store(pNewChunk.release(), std::memory_order_release);
+		});
+		return *subtree.pChunk.load(std::memory_order_acquire);
+	}
+
+	// Counts the nodes of the chunk and of its expanded sub-trees
+	static size_t getNumNodes(const BSPChunk& chunk)
+	{
+		size_t res = chunk.vNodes.size();
+		for (const auto& pSubtree : chunk.vpSubtrees) {
+			const BSPChunk* pChunk = pSubtree->pChunk.load(std::memory_order_acquire);
+			if (pChunk) res += getNumNodes(*pChunk);
+		}
+		return res;
+	}
 
-		return std::make_shared<CBSPNode>(splitDim, splitVal, pLeft, pRight);
+	// Counts the primitive references of the chunk and of its sub-trees
+	static size_t getNumPrimRefs(const BSPChunk& chunk)
+	{
+		size_t res = chunk.vPrimIdx.size();
+		for (const auto& pSubtree : chunk.vpSubtrees) {
+			const BSPChunk* pChunk = pSubtree->pChunk.load(std::memory_order_acquire);
+			res += pChunk ? getNumPrimRefs(*pChunk) : pSubtree->vIdx.size();
+		}
+		return res;
+	}
+
+	// Calculates the memory occupied by the chunk and by its sub-trees
+	static size_t getMemoryUsage(const BSPChunk& chunk)
+	{
+		size_t res = chunk.vNodes.capacity() * sizeof(CBSPNode) + chunk.vPrimIdx.capacity() * sizeof(dword);
+		for (const auto& pSubtree : chunk.vpSubtrees) {
+			res += sizeof(BSPSubtree) + pSubtree->vIdx.capacity() * sizeof(dword);
+			const BSPChunk* pChunk = pSubtree->pChunk.load(std::memory_order_acquire);
+			if (pChunk) res += sizeof(BSPChunk) + getMemoryUsage(*pChunk);
+		}
+		return res;
+	}
+
+	/**
+	 * @brief Traverses the ray \b ray through the sub-tree of node \b node and checks for intersection with a primitive
+	 * @details The nodes, which remain to be visited, are kept on a fixed-size stack. The unbuilt sub-trees on the way are expanded.
+	 * A primitive, referenced by several leaves, is usually tested only once: the recently tested primitives are remembered in a small
+	 * direct-mapped mailbox of the ray. If the intersection is found, \b ray.t is updated
+	 * @param[in,out] ray The ray
+	 * @param[in] pChunk The chunk of the root node of the sub-tree
+	 * @param[in] node The index of the root node of the sub-tree within the chunk
+	 * @param[in] t0 The distance from ray origin at which the ray enters the sub-tree
+	 * @param[in] t1 The distance from ray origin at which the ray leaves the sub-tree
+	 */
+	void intersect(Ray& ray, const BSPChunk* pChunk, size_t node, float t0, float t1) const
+	{
+		struct StackEntry {
+			const BSPChunk*	pChunk;
+			size_t			node;
+			float			t0;
+			float			t1;
+		};
+		std::array<StackEntry, maxStackDepth> stack;
+		size_t top = 0;
+		std::array<dword, m_mailboxSize> mailbox;
+		mailbox.fill(std::numeric_limits<dword>::max());
+
+		for (;;) {
+			const CBSPNode* pNode = &pChunk->vNodes[node];
+			while (!pNode->isLeaf()) {
+				// the near child is the one containing the ray origin
+				int dim = pNode->getSplitDim();
+				float splitVal = pNode->getSplitVal();
+				bool leftIsNear = ray.org.val[dim] < splitVal || (ray.org.val[dim] == splitVal && ray.dir.val[dim] <= 0);
+				size_t nearNode = leftIsNear ? node + 1 : pNode->Right();
+				size_t farNode = leftIsNear ? pNode->Right() : node + 1;
+
+				float d = (splitVal - ray.org.val[dim]) / ray.dir.val[dim];	// distance to the splitting plane
+				if (d <= 0 || d > t1 || isnan(d))								// the ray starting on the plane stays in the near child
+					node = nearNode;
+				else if (d < t0)
+					node = farNode;
+				else {
+					stack[top++] = StackEntry{ pChunk, farNode, d, t1 };
+					node = nearNode;
+					t1 = d;
+				}
+				pNode = &pChunk->vNodes[node];
+			}
+			if (pNode->isUnbuilt()) {
+				// the region of the sub-tree is the region of the node, thus t0 and t1 remain valid
+				pChunk = &expand(*pChunk->vpSubtrees[pNode->getSubtree()]);
+				node = 0;
+				continue;
+			}
+
+			const dword* pIdx = pChunk->vPrimIdx.data() + pNode->getPrimOffset();
+			for (dword i = 0; i < pNode->getNumPrims(); i++) {
+				dword& slot = mailbox[pIdx[i] % m_mailboxSize];
+				if (slot == pIdx[i]) continue;			// already tested
+				slot = pIdx[i];
+				m_vpPrims[pIdx[i]]->intersect(ray);
+			}
+			if (ray.t <= t1 || top == 0) return;			// the closest hit lies in the current node
+			top--;
+			pChunk = stack[top].pChunk;
+			node = stack[top].node;
+			t0 = stack[top].t0;
+			t1 = stack[top].t1;
+		}
 	}
 
 	
 private:
-	CBoundingBox 	m_treeBoundingBox;		///<
-	size_t			m_maxDepth;				///< The maximum allowed depth of the tree
-	size_t			m_minPrimitives;		///< The minimum number of primitives in a leaf-node
-	ptr_bspnode_t   m_root = nullptr;		///<
+	CBoundingBox 				m_treeBoundingBox;		///< The bounding box of all the primitives
+	size_t						m_maxDepth = 0;			///< The maximum allowed depth of the tree
+	size_t						m_minPrimitives = 0;	///< The minimum number of primitives in a leaf-node
+	bool						m_lazy = false;			///< The flag indicating whether the sub-trees are split on demand
+	std::vector<ptr_prim_t>		m_vpPrims;				///< The primitives of the tree
+	BSPChunk					m_root;					///< The root chunk of the tree. Unless the tree is built lazily, it contains the whole tree
+	BSPPrimBounds				m_primBounds;			///< The bounds of the primitives. After an eager build they are released
+	static constexpr size_t		m_lazyLevels = 4;		///< The number of levels, split at once, when an unbuilt sub-tree is expanded
+	static constexpr size_t		m_mailboxSize = 16;		///< The number of the recently tested primitives, remembered per ray
+	static constexpr size_t		m_maxTraceDepth = 8;	///< The deepest level of the build recursion, which is traced (Ref. CTracer)
 };
-	
@@ -1,43 +1,61 @@
 #include "BoundingBox.h"
 #include "ray.h"
 
-namespace {
-	inline Vec3f Min3f(const Vec3f a, const Vec3f b)
-	{
-		return Vec3f(MIN(a.val[0], b.val[0]), MIN(a.val[1], b.val[1]), MIN(a.val[2], b.val[2]));
-	}
-
-	inline Vec3f Max3f(const Vec3f a, const Vec3f b)
-	{
-		return Vec3f(MAX(a.val[0], b.val[0]), MAX(a.val[1], b.val[1]), MAX(a.val[2], b.val[2]));
-	}
-}
-
-void CBoundingBox::extend(const Vec3f& p)
+void CBoundingBox::extend(const Vec3fa& p)
 {
-	// --- PUT YOUR CODE HERE ---
+	m_minPoint = Min3f(p, m_minPoint);
+	m_maxPoint = Max3f(p, m_maxPoint);
 }
 	
 void CBoundingBox::extend(const CBoundingBox& box)
 {
-	// --- PUT YOUR CODE HERE ---
+	m_minPoint = Min3f(box.m_minPoint, m_minPoint);
+	m_maxPoint = Max3f(box.m_maxPoint, m_maxPoint);
 }
 
 std::pair<CBoundingBox, CBoundingBox> CBoundingBox::split(int dim, float val) const
 {
-	// --- PUT YOUR CODE HERE ---
 	auto res = std::make_pair(*this, *this);
+	res.first.m_maxPoint.val[dim] = val;
+	res.second.m_minPoint.val[dim] = val;
 	return res;
 }
 
+void CBoundingBox::intersect(const CBoundingBox& box)
+{
+	m_minPoint = Max3f(box.m_minPoint, m_minPoint);
+	m_maxPoint = Min3f(box.m_maxPoint, m_maxPoint);
+}
+
 bool CBoundingBox::overlaps(const CBoundingBox& box) const
 {
-	// --- PUT YOUR CODE HERE ---
-	return false;
+	for (int i = 0; i < 3; i++) {
+		if (box.m_minPoint.val[i] > m_maxPoint.val[i]) return false;
+		if (box.m_maxPoint.val[i] < m_minPoint.val[i]) return false;
+	}
+	return true;
 }
 	
-void CBoundingBox::clip(const Ray& ray, double& t0, double& t1) const
+void CBoundingBox::clip(const Ray& ray, float& t0, float& t1) const
 {
-	// --- PUT YOUR CODE HERE ---
+	// the relative error bound of the 3 rounded operations, which tNear and tFar are calculated with
+	static constexpr float gamma3 = 3 * 0.5f * std::numeric_limits<float>::epsilon() / (1 - 3 * 0.5f * std::numeric_limits<float>::epsilon());
+	for (int i = 0; i < 3; i++) {
+		if (ray.dir.val[i] == 0) {
+			if (ray.org.val[i] < m_minPoint.val[i] || ray.org.val[i] > m_maxPoint.val[i]) {
+				t1 = -Infty;
+				return;
+			}
+			continue;
+		}
+		float d = 1.0f / ray.dir.val[i];
+		float tNear = (m_minPoint.val[i] - ray.org.val[i]) * d;
+		float tFar  = (m_maxPoint.val[i] - ray.org.val[i]) * d;
+		if (tNear > tFar) std::swap(tNear, tFar);
+		tFar *= 1 + 2 * gamma3;			// the rounding errors may not cut off the grazing rays
+		if (tNear > t0) t0 = tNear;
+		if (tFar < t1) t1 = tFar;
+		if (t0 > t1) return;
+	}
 }
 	
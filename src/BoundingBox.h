@@ -1,6 +1,6 @@
 #pragma once
 
-#include "types.h"
+#include "vec3fa.h"
 
 struct Ray;
 
@@ -17,7 +17,7 @@ public:
 	 * @param minPoint The minimal point defying the size of the bounding box
 	 * @param maxPoint The maximal point defying the size of the bounding box
 	 */
-	CBoundingBox(const Vec3f& minPoint = Vec3f::all(Infty), const Vec3f& maxPoint = Vec3f::all(-Infty))
+	CBoundingBox(const Vec3fa& minPoint = Vec3fa::all(Infty), const Vec3fa& maxPoint = Vec3fa::all(-Infty))
 		: m_minPoint(minPoint)
 		, m_maxPoint(maxPoint)
 	{}
@@ -31,7 +31,7 @@ public:
 	 * @brief Extends the bounding box to contain point \b p
 	 * @param p A point
 	 */
-	void extend(const Vec3f& p);
+	void extend(const Vec3fa& p);
 	
 	/**
 	 * @brief Extends the bounding box to contain bounding box \b box
@@ -46,6 +46,32 @@ public:
 	 * @returns A pair of bounding boxes, as a matter of fact "left" and "right" bounding boxes
 	 */
 	std::pair<CBoundingBox, CBoundingBox> split(int dim, float val) const;
+	/**
+	 * @brief Shrinks the bounding box to its intersection with bounding box \b box
+	 * @details If the bounding boxes do not overlap, the resulting bounding box is empty (Ref. isEmpty())
+	 * @param box The second bounding box
+	 */
+	void intersect(const CBoundingBox& box);
+	/**
+	 * @brief Checks whether the bounding box contains no points
+	 * @retval true If the minimal point exceeds the maximal point in any dimension
+	 * @retval false Otherwise
+	 */
+	bool isEmpty(void) const
+	{
+		return m_minPoint.val[0] > m_maxPoint.val[0] || m_minPoint.val[1] > m_maxPoint.val[1] || m_minPoint.val[2] > m_maxPoint.val[2];
+	}
+	/**
+	 * @brief Checks whether the bounding box has finite extent
+	 * @retval true If all the coordinates of the minimal and maximal points are finite
+	 * @retval false Otherwise, e.g. for the bounding box of an infinite plane or for an empty bounding box
+	 */
+	bool isBounded(void) const
+	{
+		for (int i = 0; i < 3; i++)
+			if (!std::isfinite(m_minPoint.val[i]) || !std::isfinite(m_maxPoint.val[i])) return false;
+		return true;
+	}
 	/**
 	 * @brief Checks if the current bounding box overlaps with the argument bounding box \b box
 	 * @param box The secind bounding box to be checked with
@@ -60,19 +86,19 @@ public:
 	 * @param[in,out] t0 The distance from ray origin at which the ray enters the bounding box
 	 * @param[in,out] t1 The distance from ray origin at which the ray leaves the bounding box
 	 */
-	void clip(const Ray& ray, double& t0, double& t1) const;
+	void clip(const Ray& ray, float& t0, float& t1) const;
 	/**
 	 * @brief Returns the minimal point defying the size of the bounding box
 	 * @returns The minimal point defying the size of the bounding box
 	 */
-	Vec3f getMinPoint(void) const { return m_minPoint; }
+	Vec3fa getMinPoint(void) const { return m_minPoint; }
 	/**
 	 * @brief Returns the maximal point defying the size of the bounding box
 	 * @returns The maximal point defying the size of the bounding box
 	 */
-	Vec3f getMaxPoint(void) const { return m_maxPoint; }
+	Vec3fa getMaxPoint(void) const { return m_maxPoint; }
 	
 private:
-	Vec3f m_minPoint;	///< The minimal point defying the size of the bounding box
-	Vec3f m_maxPoint;	///< The maximal point defying the size of the bounding box
+	Vec3fa m_minPoint;	///< The minimal point defying the size of the bounding box
+	Vec3fa m_maxPoint;	///< The maximal point defying the size of the bounding box
 };
@@ -33,6 +33,10 @@ public:
         m_xAxis = normalize(m_xAxis);
         m_yAxis = normalize(m_yAxis);
         m_zAxis = normalize(m_zAxis);
+
+        m_xStep = 2 * getAspectRatio() / resolution.width * m_xAxis;
+        m_yStep = 2.0f / resolution.height * m_yAxis;
+        m_corner = m_focus * m_zAxis - getAspectRatio() * m_xAxis - m_yAxis;
     }
     virtual ~CCameraPerspective(void) = default;
 
@@ -41,15 +45,117 @@ public:
         float dx = 0.5f;	// x-shift to the center of the pixel
         float dy = 0.5f;	// y-shift to the center of the pixel
 
-        // Screen space coordinates [-1, 1]
-        float sscx = 2 * (x + dx) / getResolution().width - 1;
-        float sscy = 2 * (y + dy) / getResolution().height - 1;
-
         ray.org = m_pos;
-        ray.dir = normalize(getAspectRatio() * sscx * m_xAxis + sscy * m_yAxis + m_focus * m_zAxis);
+        ray.dir = getDirection(getDirection(0, static_cast<float>(y)), x + dx, dy);
         ray.t = std::numeric_limits<float>::infinity();
     }
 
+    virtual void InitRays(const Rect& tile, RayBatch& rays, const Vec2f* pOffsets = nullptr) override
+    {
+        rays.resize(static_cast<size_t>(tile.area()));
+        std::fill(rays.orgX.begin(), rays.orgX.end(), m_pos.val[0]);
+        std::fill(rays.orgY.begin(), rays.orgY.end(), m_pos.val[1]);
+        std::fill(rays.orgZ.begin(), rays.orgZ.end(), m_pos.val[2]);
+
+        for (int y = 0; y < tile.height; y++) {
+            const Vec3f rowTerm = getDirection(0, static_cast<float>(tile.y + y));     // the per-row term
+            size_t i = static_cast<size_t>(y) * tile.width;
+            const size_t end = i + tile.width;
+            float x = static_cast<float>(tile.x);
+#ifdef VEC3FA_SSE
+            // 4 rays at once: the column coordinates advance by 4 pixels, the camera terms stay in the registers
+            const __m128 row[3]     = { _mm_set1_ps(rowTerm.val[0]), _mm_set1_ps(rowTerm.val[1]), _mm_set1_ps(rowTerm.val[2]) };
+            const __m128 xStep[3]   = { _mm_set1_ps(m_xStep.val[0]), _mm_set1_ps(m_xStep.val[1]), _mm_set1_ps(m_xStep.val[2]) };
+            const __m128 yStep[3]   = { _mm_set1_ps(m_yStep.val[0]), _mm_set1_ps(m_yStep.val[1]), _mm_set1_ps(m_yStep.val[2]) };
+            float* dir[3]           = { rays.dirX.data(), rays.dirY.data(), rays.dirZ.data() };
+            __m128 px = _mm_setr_ps(x, x + 1, x + 2, x + 3);
+            for (; i + 4 <= end; i += 4, x += 4, px = _mm_add_ps(px, _mm_set1_ps(4))) {
+                __m128 dx = _mm_set1_ps(0.5f);
+                __m128 dy = _mm_set1_ps(0.5f);
+                if (pOffsets) {
+                    dx = _mm_setr_ps(pOffsets[i][0], pOffsets[i + 1][0], pOffsets[i + 2][0], pOffsets[i + 3][0]);
+                    dy = _mm_setr_ps(pOffsets[i][1], pOffsets[i + 1][1], pOffsets[i + 2][1], pOffsets[i + 3][1]);
+                }
+                const __m128 sx = _mm_add_ps(px, dx);
+                __m128 d[3];
+                for (int c = 0; c < 3; c++)
+                    d[c] = _mm_add_ps(_mm_add_ps(row[c], _mm_mul_ps(sx, xStep[c])), _mm_mul_ps(dy, yStep[c]));
+                __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])), _mm_mul_ps(d[2], d[2])));
+                __m128 inv = _mm_div_ps(_mm_set1_ps(1), len);
+                for (int c = 0; c < 3; c++)
+                    _mm_storeu_ps(dir[c] + i, _mm_mul_ps(d[c], inv));
+            }
+#endif
+            for (; i < end; i++, x++) {
+                Vec3f dir = pOffsets ? getDirection(rowTerm, x + pOffsets[i][0], pOffsets[i][1]) : getDirection(rowTerm, x + 0.5f, 0.5f);
+                rays.dirX[i] = dir.val[0];
+                rays.dirY[i] = dir.val[1];
+                rays.dirZ[i] = dir.val[2];
+            }
+        }
+    }
+
+    virtual std::optional<CFrustum> getFrustum(const Rect& tile) const override
+    {
+        // the corner rays pass through the outer edges of the tile pixels
+        float x0 = static_cast<float>(tile.x);
+        float y0 = static_cast<float>(tile.y);
+        float x1 = static_cast<float>(tile.x + tile.width);
+        float y1 = static_cast<float>(tile.y + tile.height);
+        return CFrustum(m_pos, { getDirection(x0, y0), getDirection(x1, y0), getDirection(x1, y1), getDirection(x0, y1) });
+    }
+
+    virtual float getProjectedSize(const CBoundingBox& box) const override
+    {
+        // the bounding sphere is seen under the angle 2 * atan(r / sqrt(d^2 - r^2)); the screen height 2 corresponds to the focal length
+        const Vec3fa diff = 0.5f * (box.getMinPoint() + box.getMaxPoint()) - m_pos;
+        const float r = 0.5f * norm(box.getMaxPoint() - box.getMinPoint());
+        const float d2 = diff.dot(diff);
+        if (d2 <= r * r) return Infty;
+        return r / sqrtf(d2 - r * r) * m_focus * getResolution().height;
+    }
+
+    virtual bool project(const Vec3f& point, Vec2f& pixel, float& depth) const override
+    {
+        // the direction, scaled to the unit distance along the z-axis, is corner + x * xStep + y * yStep, where the steps are orthogonal
+        const Vec3f diff = point - m_pos;
+        const float z = diff.dot(m_zAxis);
+        if (z <= 0) return false;
+        const Vec3f q = (m_focus / z) * diff - m_corner;
+        pixel = Vec2f(q.dot(m_xStep) / m_xStep.dot(m_xStep), q.dot(m_yStep) / m_yStep.dot(m_yStep));
+        depth = sqrtf(diff.dot(diff));
+        return true;
+    }
+
+
+private:
+    /**
+     * @brief Returns the (not normalized) direction of the ray passing through the point \b (x,y) on the camera screen
+     * @param x The x-coordinate of the point in pixels
+     * @param y The y-coordinate of the point in pixels
+     * @return The direction vector
+     */
+    Vec3f getDirection(float x, float y) const
+    {
+        // Screen space coordinates [-1, 1] are linear in the pixel coordinates, thus the direction is
+        // aspectRatio * sscx * xAxis + sscy * yAxis + focus * zAxis = corner + x * xStep + y * yStep
+        return m_corner + x * m_xStep + y * m_yStep;
+    }
+    /**
+     * @brief Returns the normalized direction of the ray passing through the point \b (x, y + dy) on the camera screen
+     * @details It is the scalar counterpart of the vectorized ray generation in InitRays()
+     * @param rowTerm The direction through the point \b (0, y), i.e. getDirection(0, y)
+     * @param x The x-coordinate of the point in pixels
+     * @param dy The sub-pixel offset of the point along the y-axis
+     * @return The normalized direction vector
+     */
+    Vec3f getDirection(const Vec3f& rowTerm, float x, float dy) const
+    {
+        Vec3f dir = rowTerm + x * m_xStep + dy * m_yStep;
+        float len = sqrtf(dir.val[0] * dir.val[0] + dir.val[1] * dir.val[1] + dir.val[2] * dir.val[2]);
+        return (1 / len) * dir;
+    }
+
 
 private:
     // input values
@@ -62,5 +168,8 @@ private:
     Vec3f m_xAxis;  ///< Camera x-axis in WCS
     Vec3f m_yAxis;  ///< Camera y-axis in WCS
     Vec3f m_zAxis;  ///< Camera z-axis in WCS
+    Vec3f m_xStep;  ///< The change of the ray direction per pixel along the x-axis
+    Vec3f m_yStep;  ///< The change of the ray direction per pixel along the y-axis
+    Vec3f m_corner; ///< The direction of the ray through the corner (0, 0) of the camera screen
 };
 
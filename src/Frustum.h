@@ -0,0 +1,61 @@
+// Frustum class for beam culling
+#pragma once
+
+#include "BoundingBox.h"
+
+// ================================ Frustum Class ================================
+/**
+ * @brief Frustum (beam) class
+ * @details The frustum is the infinite pyramid with the apex in the common origin of a beam of rays.
+ * It is bounded by four side planes passing through the apex and the neighbouring corner rays of the beam.
+ */
+class CFrustum
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param org The common origin of the rays (apex of the frustum)
+	 * @param corners The directions of the four corner rays of the beam, given in cyclic order
+	 */
+	CFrustum(const Vec3f& org, const std::array<Vec3f, 4>& corners)
+		: m_org(org)
+	{
+		Vec3f center = corners[0] + corners[1] + corners[2] + corners[3];
+		for (size_t i = 0; i < 4; i++) {
+			Vec3f normal = corners[i].cross(corners[(i + 1) % 4]);
+			if (normal.dot(center) < 0) normal = -normal;
+			m_normals[i] = normalize(normal);
+		}
+	}
+	~CFrustum(void) = default;
+
+	/**
+	 * @brief Checks if the frustum may overlap with the bounding box \b box
+	 * @details The test is conservative: it returns false only if the box lies completely outside of one of the side planes.
+	 * Thus, if it returns false, none of the rays of the beam intersects the box
+	 * @param box The bounding box
+	 */
+	bool overlaps(const CBoundingBox& box) const
+	{
+		const Vec3f minPoint = box.getMinPoint() - m_org;
+		const Vec3f maxPoint = box.getMaxPoint() - m_org;
+		for (const Vec3f& normal : m_normals) {
+			// the corner of the box, which lies furthest in the direction of the normal
+			float dist = 0;
+			for (int i = 0; i < 3; i++)
+				if (normal.val[i] != 0) dist += normal.val[i] * (normal.val[i] > 0 ? maxPoint.val[i] : minPoint.val[i]);
+			if (dist < -Epsilon) return false;
+		}
+		return true;
+	}
+	/**
+	 * @brief Returns the apex of the frustum
+	 * @returns The common origin of the rays
+	 */
+	Vec3f getOrigin(void) const { return m_org; }
+
+
+private:
+	Vec3f						m_org;			///< The apex of the frustum
+	std::array<Vec3f, 4>		m_normals;		///< The inward-facing normals of the side planes
+};
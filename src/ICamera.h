@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ray.h"
+#include "Frustum.h"
 
 // ================================ Camera Interface Class ================================
 /**
@@ -33,6 +34,57 @@ public:
      * @param[in] y The y-coordinate of the pixel lying on the camera screen
      */
     virtual void InitRay(Ray& ray, int x, int y) = 0;
+    /**
+     * @brief Initializes the rays passing through the pixels of the image region \b tile
+     * @details The rays are stored in \b rays row by row, i.e. the ray of the pixel (x, y) has index (y - tile.y) * tile.width + (x - tile.x).
+     * The default implementation calls InitRay() for every pixel, thus it ignores the sub-pixel offsets.
+     * The cameras should override it with a version, which computes the per-row and per-column terms once
+     * @param[in] tile The image region in pixels
+     * @param[out] rays The batch of rays to be filled. It is resized to the area of \b tile
+     * @param[in] pOffsets The array of the sub-pixel positions in [0; 1)^2, one per pixel in the same order as the rays, or nullptr for the pixel centers
+     */
+    virtual void InitRays(const Rect& tile, RayBatch& rays, const Vec2f* pOffsets = nullptr)
+    {
+        rays.resize(static_cast<size_t>(tile.area()));
+        Ray ray;
+        for (size_t i = 0; i < rays.size(); i++) {
+            InitRay(ray, tile.x + static_cast<int>(i) % tile.width, tile.y + static_cast<int>(i) / tile.width);
+            rays.orgX[i] = ray.org.val[0];
+            rays.orgY[i] = ray.org.val[1];
+            rays.orgZ[i] = ray.org.val[2];
+            rays.dirX[i] = ray.dir.val[0];
+            rays.dirY[i] = ray.dir.val[1];
+            rays.dirZ[i] = ray.dir.val[2];
+        }
+    }
+    /**
+     * @brief Returns the frustum containing all the rays passing through the pixels of the image region \b tile
+     * @details The frustum is used for culling the scene for the whole tile at once.
+     * Cameras, whose rays do not share a common origin, should return no frustum
+     * @param tile The image region in pixels
+     * @return The frustum, if it exists
+     */
+    virtual std::optional<CFrustum> getFrustum(const Rect& tile) const { return std::nullopt; }
+    /**
+     * @brief Returns the size of the bounding box \b box on the camera screen
+     * @details It is used for choosing the level of detail of the distant objects (Ref. CSolidLOD::selectLevel()).
+     * The default implementation returns infinity, thus the objects are rendered in full detail
+     * @param box The bounding box
+     * @return The diameter of the projection of the bounding sphere of \b box in pixels
+     */
+    virtual float getProjectedSize(const CBoundingBox& box) const { return Infty; }
+    /**
+     * @brief Projects the point \b point onto the camera screen
+     * @details It is the inverse of the ray generation: the ray through \b pixel hits the point at distance \b depth.
+     * It is used for reprojecting the hit points of the previous frame (Ref. CRendererReprojection).
+     * The default implementation does not project, thus every pixel is traced
+     * @param[in] point The point in WCS
+     * @param[out] pixel The continuous pixel coordinates of the projection, i.e. the pixel (x, y) covers [x; x + 1) x [y; y + 1)
+     * @param[out] depth The distance from the camera origin to the point along the ray
+     * @retval true If the point lies in front of the camera
+     * @retval false Otherwise
+     */
+    virtual bool project(const Vec3f& point, Vec2f& pixel, float& depth) const { return false; }
 
     /**
      * @brief Retuns the camera resolution in pixels
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.h"
+#include "BoundingBox.h"
 
 struct Ray;
 
@@ -33,6 +34,19 @@ public:
 	 * @retval false Otherwise
 	 */
 	virtual bool shadow(void) const { return m_shadow; }
+	/**
+	 * @brief Returns the spatial bounds of the light source
+	 * @details The bounds are used for building the light hierarchy (Ref. @ref CLightBVH).
+	 * Light sources which are not localized in space should return an infinite bounding box
+	 * @returns The bounding box, which contains the light source
+	 */
+	virtual CBoundingBox getBoundingBox(void) const { return CBoundingBox(Vec3f::all(-Infty), Vec3f::all(Infty)); }
+	/**
+	 * @brief Returns the (scalar) power of the light source
+	 * @details The power is used as the importance of the light source, when the lights are sampled stochastically
+	 * @returns The power of the light source
+	 */
+	virtual float getPower(void) const { return 1.0f; }
 
 
 private:
@@ -8,6 +8,9 @@
 
 struct Ray;
 
+/// Primitive type tag, used for the closed-set shading mode (Ref. ShaderDispatch.h)
+enum class PrimType { custom, sphere, plane, triangle };
+
 // ================================ Primitive Interface Class ================================
 /**
  * @brief Geometrical Primitives (Prims) base abstract class
@@ -18,8 +21,9 @@ public:
 	/**
 	 * @brief Constructor
 	 * @param pShader Pointer to the shader to be applied for the primitive
+	 * @param type The primitive type tag. User-defined primitives should keep the default \b PrimType::custom value
 	 */
-	IPrim(ptr_shader_t pShader) : m_pShader(pShader) {}
+	IPrim(ptr_shader_t pShader, PrimType type = PrimType::custom) : m_pShader(pShader), m_type(type) {}
 	IPrim(const IPrim&) = delete;
 	virtual ~IPrim(void) = default;
 	const IPrim& operator=(const IPrim&) = delete;
@@ -53,15 +57,34 @@ public:
 	 * @returns The bounding box, which contain the primitive
 	 */
 	virtual CBoundingBox getBoundingBox(void) const = 0;
+	/**
+	 * @brief Returns the bounding box of the part of the primitive, which lies inside bounding box \b box
+	 * @details It is used by the BSP tree builder to avoid referencing a primitive from the nodes, which only its bounding box overlaps.
+	 * The default implementation returns the intersection of the bounding box of the primitive with \b box
+	 * @param box The clipping bounding box
+	 * @returns The bounding box of the clipped primitive. It is empty (Ref. CBoundingBox::isEmpty()) if the primitive lies outside \b box
+	 */
+	virtual CBoundingBox getClippedBoundingBox(const CBoundingBox& box) const
+	{
+		CBoundingBox res = getBoundingBox();
+		res.intersect(box);
+		return res;
+	}
 	/**
 	 * @brief Returns the primitive's shader
 	 * @return The pointer to the primitive's shader
 	*/
 	ptr_shader_t getShader(void) const { return m_pShader; }
+	/**
+	 * @brief Returns the primitive type tag
+	 * @return The primitive type tag
+	 */
+	PrimType getType(void) const { return m_type; }
 
 
 private:
-	ptr_shader_t m_pShader;		///< Pointer to the sahder, see @ref IShader
+	ptr_shader_t	m_pShader;	///< Pointer to the sahder, see @ref IShader
+	const PrimType	m_type;		///< The primitive type tag
 };
 
 using ptr_prim_t = std::shared_ptr<IPrim>;
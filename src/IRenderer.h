@@ -0,0 +1,113 @@
+// Renderer Abstract Interface class
+#pragma once
+
+#include "ShaderDispatch.h"
+#include "RenderContext.h"
+#include "Numa.h"
+#include "Tracer.h"
+
+// ================================ Renderer Interface Class ================================
+/**
+ * @brief Basic renderer abstract interface class
+ * @details The renderer splits the image of the active scene camera into tiles and renders them in parallel.
+ * The tiles may be rendered in any order and by any thread: the renderers keep their per-thread state in the rendering context
+ * (Ref. CRenderContext) and key the random numbers by the pixel and sample indices, so the image is reproducible for any number of threads.
+ * In a NUMA mode the rendering threads are pinned to the nodes (Ref. CNuma)
+ */
+class IRenderer
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param scene Reference to the scene
+	 * @param tileSize The size of the image tiles in pixels
+	 */
+	IRenderer(CScene& scene, Size tileSize = Size(32, 32))
+		: m_scene(scene)
+		, m_tileSize(tileSize)
+	{}
+	IRenderer(const IRenderer&) = delete;
+	virtual ~IRenderer(void) = default;
+	const IRenderer& operator=(const IRenderer&) = delete;
+
+	/**
+	 * @brief Sets the camera, the frame is seen by
+	 * @details It allows several renderers to render the same scene from different views at the same time
+	 * @param pCamera Pointer to the camera. If nullptr, the active camera of the scene is used
+	 */
+	void setCamera(ptr_camera_t pCamera) { m_pCamera = pCamera; }
+	/**
+	 * @brief Renders the frame, seen by the camera of the renderer (Ref. setCamera())
+	 * @return The rendered image of type CV_32FC3
+	 */
+	Mat render(void)
+	{
+		Size resolution = getCamera()->getResolution();
+		Mat img(resolution, CV_32FC3);
+		render(Rect(0, 0, resolution.width, resolution.height), img);
+		return img;
+	}
+	/**
+	 * @brief Renders a region of the frame, seen by the camera of the renderer (Ref. setCamera())
+	 * @param region The image region to be rendered
+	 * @param[in,out] img The image of type CV_32FC3 and of the camera resolution, where the region pixels are to be written to
+	 * @param sample The index of the sample. It keys the random number streams of the pixels (Ref. CRenderContext::setSample()),
+	 * thus the renders of the same region with different sample indices may be averaged
+	 */
+	void render(const Rect& region, Mat& img, int sample = 0)
+	{
+		TRACE_SCOPE("render");
+		beginFrame(region);
+		const int nTilesX = (region.width + m_tileSize.width - 1) / m_tileSize.width;
+		const int nTilesY = (region.height + m_tileSize.height - 1) / m_tileSize.height;
+		const std::thread::id caller = std::this_thread::get_id();
+		parallel_for_(Range(0, nTilesX * nTilesY), [&](const Range& range) {
+			// the calling thread takes part in rendering too, but it is not pinned, since it continues with the serial work afterwards
+			if (std::this_thread::get_id() != caller) CNuma::pinThread();
+			for (int t = range.start; t < range.end; t++) {
+				TRACE_SCOPE_ARG("tile", "tile", t);
+				int x = (t % nTilesX) * m_tileSize.width;
+				int y = (t / nTilesX) * m_tileSize.height;
+				Rect tile(region.x + x, region.y + y, MIN(m_tileSize.width, region.width - x), MIN(m_tileSize.height, region.height - y));
+				int64 ticks = getTickCount();
+				renderTile(tile, img, sample);
+				CNuma::addRays(tile.area(), (getTickCount() - ticks) / getTickFrequency());
+			}
+		});
+	}
+
+
+protected:
+	/**
+	 * @brief Prepares the rendering of a region of the frame
+	 * @details This function is called once per render() in the calling thread before the tiles are rendered. The default implementation does nothing
+	 * @param region The image region to be rendered
+	 */
+	virtual void beginFrame(const Rect& region) {}
+	/**
+	 * @brief Renders a tile of the image
+	 * @details This function is called concurrently from multiple threads. The per-thread data should be kept in CRenderContext::get()
+	 * @param tile The tile region in the image
+	 * @param[out] img The image, where the tile pixels are to be written to
+	 * @param sample The index of the sample (Ref. CRenderContext::setSample())
+	 */
+	virtual void renderTile(const Rect& tile, Mat& img, int sample) = 0;
+	/**
+	 * @brief Returns the scene
+	 * @return The reference to the scene
+	 */
+	CScene& getScene(void) const { return m_scene; }
+	/**
+	 * @brief Returns the camera, the frame is seen by
+	 * @return The pointer to the camera of the renderer or to the active camera of the scene
+	 */
+	ptr_camera_t getCamera(void) const { return m_pCamera ? m_pCamera : m_scene.getActiveCamera(); }
+
+
+private:
+	CScene&			m_scene;				///< The scene to be rendered
+	Size			m_tileSize;				///< The size of the image tiles in pixels
+	ptr_camera_t	m_pCamera = nullptr;	///< The camera of the renderer or nullptr to use the active camera of the scene
+};
+
+using ptr_renderer_t = std::shared_ptr<IRenderer>;
@@ -5,6 +5,12 @@
 #include "types.h"
 
 struct Ray;
+struct ShadowRay;
+struct SecondaryRay;
+
+/// Shader type tag, used for the closed-set shading mode (Ref. ShaderDispatch.h)
+enum class ShaderType { custom, flat, eyelight, phong };
+
 // ================================ Shader Interface Class ================================
 /**
  * @brief Basic shader abstract interface class
@@ -12,7 +18,11 @@ struct Ray;
 class IShader
 {
 public:
-	IShader(void) = default;
+	/**
+	 * @brief Constructor
+	 * @param type The shader type tag. User-defined shaders should keep the default \b ShaderType::custom value
+	 */
+	IShader(ShaderType type = ShaderType::custom) : m_type(type) {}
 	IShader(const IShader&) = delete;
 	virtual ~IShader(void) = default;
 	const IShader& operator=(const IShader&) = delete;
@@ -24,6 +34,34 @@ public:
 	 * @return The color of the hit objesct
 	 */
 	virtual Vec3f shade(const Ray& ray) const = 0;
+	/**
+	 * @brief Calculates the color of the hit by the ray \b ray object, deferring the visibility tests
+	 * @details Instead of tracing the shadow rays immediately, this function appends them to \b vShadowRays.
+	 * The contribution of every appended shadow ray is to be added to the returned color, if the ray is not occluded (Ref. @ref ShadowRay).
+	 * The default implementation does not cast shadow rays and is equivalent to shade()
+	 * @param[in] ray The ray hitting the primitive. ray.hit must point to the primitive
+	 * @param[in,out] vShadowRays The container, where the shadow rays are appended to
+	 * @return The visibility-independent part of the color of the hit object
+	 */
+	virtual Vec3f shadeDeferred(const Ray& ray, std::vector<ShadowRay>& vShadowRays) const { return shade(ray); }
+	/**
+	 * @brief Spawns the secondary rays (reflection, refraction) at the hit point of the ray \b ray
+	 * @details The color of the hit is shade() plus the sum of the colors seen along the secondary rays, multiplied with their weights.
+	 * The secondary rays are traced by the renderer (Ref. CRayTracer). The default implementation spawns no rays
+	 * @param[in] ray The ray hitting the primitive. ray.hit must point to the primitive
+	 * @param[out] secondary The secondary rays
+	 * @return The number of the secondary rays written to \b secondary
+	 */
+	virtual size_t scatter(const Ray& ray, std::array<SecondaryRay, 2>& secondary) const { return 0; }
+	/**
+	 * @brief Returns the shader type tag
+	 * @return The shader type tag
+	 */
+	ShaderType getType(void) const { return m_type; }
+
+
+private:
+	const ShaderType m_type;	///< The shader type tag
 };
 
 using ptr_shader_t = std::shared_ptr<IShader>;
@@ -0,0 +1,278 @@
+// Streaming Input File class
+#pragma once
+
+#include "types.h"
+#include "Tracer.h"
+#include <condition_variable>
+#include <cstdio>
+#include <istream>
+#include <mutex>
+#include <thread>
+#ifdef ENABLE_GZIP
+#include <zlib.h>
+#endif
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+/// Compression formats of the input files
+enum class Compression {
+	none,		///< Plain file
+	gzip,		///< gzip (.gz) file
+	zstd		///< Zstandard (.zst) file
+};
+
+// ================================ Input Stream Class ================================
+/**
+ * @brief Streaming input file class
+ * @details Reads a plain, gzip or zstd compressed file as a text stream, thus the compressed meshes (e.g. \a .obj.gz or \a .obj.zst)
+ * are parsed directly without decompressing them to the disk first. The format is detected by the magic number of the file.
+ * A producer thread reads and decompresses the file into a ring of fixed-size chunks, while the calling thread consumes the completed chunks,
+ * thus decompression overlaps with parsing and the peak memory is bounded by the ring (plus the window of the decompressor) regardless of the file size.
+ * @note The gzip and zstd formats are supported only if ENABLE_GZIP and ENABLE_ZSTD are defined respectively
+ */
+class CInputStream : public std::istream
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @details Opens the file and starts decompressing it in the producer thread
+	 * @param fileName The full path to the file
+	 * @param chunkSize The size of a chunk in bytes
+	 * @param nChunks The number of chunks in the ring
+	 */
+	CInputStream(const std::string& fileName, size_t chunkSize = 1 << 20, size_t nChunks = 4)
+		: std::istream(nullptr)
+		, m_fileName(fileName)
+		, m_vvChunks(MAX(size_t(2), nChunks), std::vector<char>(MAX(size_t(1), chunkSize)))
+		, m_vChunkSizes(m_vvChunks.size(), 0)
+	{
+		rdbuf(&m_buffer);
+		if (open()) m_producer = std::thread([this] { produce(); });
+		else setstate(std::ios::failbit);
+	}
+	CInputStream(const CInputStream&) = delete;
+	virtual ~CInputStream(void) { close(); }
+	CInputStream& operator=(const CInputStream&) = delete;
+
+	/**
+	 * @brief Checks whether the file is open
+	 * @retval true If the file was opened and its format is supported
+	 * @retval false Otherwise
+	 */
+	bool is_open(void) const { return m_compression != Compression::none || m_pFile; }
+	/**
+	 * @brief Stops the producer thread and closes the file
+	 */
+	void close(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cvFree.notify_all();
+		if (m_producer.joinable()) m_producer.join();
+		if (m_pFile) fclose(m_pFile);
+		m_pFile = nullptr;
+#ifdef ENABLE_GZIP
+		if (m_gzFile) gzclose(m_gzFile);
+		m_gzFile = nullptr;
+#endif
+#ifdef ENABLE_ZSTD
+		if (m_pZstd) ZSTD_freeDStream(m_pZstd);
+		m_pZstd = nullptr;
+#endif
+		m_compression = Compression::none;
+	}
+	/**
+	 * @brief Returns the compression format of the file
+	 * @returns The compression format
+	 */
+	Compression getCompression(void) const { return m_compression; }
+	/**
+	 * @brief Detects the compression format of a file by its magic number
+	 * @param fileName The full path to the file
+	 * @returns The compression format of the file, or Compression::none if the file is plain or can not be opened
+	 */
+	static Compression detect(const std::string& fileName)
+	{
+		FILE* pFile = fopen(fileName.c_str(), "rb");
+		if (!pFile) return Compression::none;
+		unsigned char magic[4] = { 0, 0, 0, 0 };
+		const size_t n = fread(magic, 1, 4, pFile);
+		fclose(pFile);
+		if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return Compression::gzip;
+		if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return Compression::zstd;
+		return Compression::none;
+	}
+
+
+private:
+	/// Stream buffer, which hands over the completed chunks of the ring to the parser
+	class CBuffer : public std::streambuf
+	{
+	public:
+		CBuffer(CInputStream& stream) : m_stream(stream) {}
+
+	protected:
+		virtual int_type underflow(void) override
+		{
+			if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+			const char* pChunk = m_stream.nextChunk(m_size);
+			if (!pChunk) return traits_type::eof();
+			char* pBegin = const_cast<char*>(pChunk);
+			setg(pBegin, pBegin, pBegin + m_size);
+			return traits_type::to_int_type(*gptr());
+		}
+
+	private:
+		CInputStream&	m_stream;
+		size_t			m_size = 0;		///< The size of the current chunk
+	};
+
+	// Opens the file and initializes the decompressor of its format
+	bool open(void)
+	{
+		const Compression compression = detect(m_fileName);
+		switch (compression) {
+			case Compression::gzip:
+#ifdef ENABLE_GZIP
+				m_gzFile = gzopen(m_fileName.c_str(), "rb");
+				if (!m_gzFile) return false;
+				gzbuffer(m_gzFile, 1 << 17);
+				break;
+#else
+				printf("ERROR: gzip support is not enabled, can't read %s\n", m_fileName.c_str());
+				return false;
+#endif
+			case Compression::zstd:
+#ifdef ENABLE_ZSTD
+				m_pFile = fopen(m_fileName.c_str(), "rb");
+				if (!m_pFile) return false;
+				m_pZstd = ZSTD_createDStream();
+				ZSTD_initDStream(m_pZstd);
+				m_vInput.resize(ZSTD_DStreamInSize());
+				break;
+#else
+				printf("ERROR: zstd support is not enabled, can't read %s\n", m_fileName.c_str());
+				return false;
+#endif
+			default:
+				m_pFile = fopen(m_fileName.c_str(), "rb");
+				if (!m_pFile) return false;
+		}
+		m_compression = compression;
+		return true;
+	}
+
+	// Producer thread: fills the free chunks of the ring with the decompressed data until the end of the file
+	void produce(void)
+	{
+		TRACE_SCOPE("decompress");
+		for (;;) {
+			size_t chunk;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cvFree.wait(lock, [this] { return m_nReady < m_vvChunks.size() || m_stop; });
+				if (m_stop) break;
+				chunk = m_tail;
+			}
+			// the chunk is not accessed by the consumer until it is committed
+			const size_t size = read(m_vvChunks[chunk].data(), m_vvChunks[chunk].size());
+			if (size == 0) break;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_vChunkSizes[chunk] = size;
+				m_tail = (m_tail + 1) % m_vvChunks.size();
+				m_nReady++;
+			}
+			m_cvReady.notify_one();
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_eof = true;
+		}
+		m_cvReady.notify_one();
+	}
+
+	// Consumer: releases the current chunk and waits for the next completed one
+	const char* nextChunk(size_t& size)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_hasChunk) {
+			m_head = (m_head + 1) % m_vvChunks.size();
+			m_nReady--;
+			m_hasChunk = false;
+			m_cvFree.notify_one();
+		}
+		m_cvReady.wait(lock, [this] { return m_nReady > 0 || m_eof; });
+		if (m_nReady == 0) return nullptr;
+		m_hasChunk = true;
+		size = m_vChunkSizes[m_head];
+		return m_vvChunks[m_head].data();
+	}
+
+	// Reads up to \b size decompressed bytes into \b pDst; returns the number of bytes read, or zero at the end of the file or on error
+	size_t read(char* pDst, size_t size)
+	{
+		switch (m_compression) {
+#ifdef ENABLE_GZIP
+			case Compression::gzip: {
+				const int res = gzread(m_gzFile, pDst, static_cast<unsigned>(size));
+				if (res < 0) {
+					int err;
+					printf("ERROR: Can't decompress %s: %s\n", m_fileName.c_str(), gzerror(m_gzFile, &err));
+					return 0;
+				}
+				return static_cast<size_t>(res);
+			}
+#endif
+#ifdef ENABLE_ZSTD
+			case Compression::zstd: {
+				ZSTD_outBuffer out = { pDst, size, 0 };
+				while (out.pos < out.size) {
+					if (m_input.pos == m_input.size) {
+						m_input = { m_vInput.data(), fread(m_vInput.data(), 1, m_vInput.size(), m_pFile), 0 };
+						if (m_input.size == 0) break;
+					}
+					const size_t res = ZSTD_decompressStream(m_pZstd, &out, &m_input);
+					if (ZSTD_isError(res)) {
+						printf("ERROR: Can't decompress %s: %s\n", m_fileName.c_str(), ZSTD_getErrorName(res));
+						return 0;
+					}
+				}
+				return out.pos;
+			}
+#endif
+			default:
+				return fread(pDst, 1, size, m_pFile);
+		}
+	}
+
+
+private:
+	const std::string				m_fileName;							///< The full path to the file
+	Compression						m_compression = Compression::none;	///< The compression format of the open file
+	FILE*							m_pFile = nullptr;					///< The plain or the zstd compressed file
+#ifdef ENABLE_GZIP
+	gzFile							m_gzFile = nullptr;					///< The gzip compressed file
+#endif
+#ifdef ENABLE_ZSTD
+	ZSTD_DStream*					m_pZstd = nullptr;					///< The zstd decompression context
+	std::vector<char>				m_vInput;							///< The compressed input buffer
+	ZSTD_inBuffer					m_input = { nullptr, 0, 0 };		///< The unconsumed part of the compressed input
+#endif
+	CBuffer							m_buffer{ *this };					///< The stream buffer of the parser
+	std::vector<std::vector<char>>	m_vvChunks;							///< The ring of the decompressed chunks
+	std::vector<size_t>				m_vChunkSizes;						///< The number of valid bytes in every chunk
+	size_t							m_head = 0;							///< The chunk to be consumed next
+	size_t							m_tail = 0;							///< The chunk to be filled next
+	size_t							m_nReady = 0;						///< The number of completed chunks, including the one being consumed
+	bool							m_hasChunk = false;					///< Whether the consumer holds the chunk at m_head
+	bool							m_eof = false;						///< Whether the producer has finished
+	bool							m_stop = false;						///< Whether the producer should stop
+	std::mutex						m_mutex;							///< Guards the state of the ring
+	std::condition_variable			m_cvReady;							///< Signals a completed chunk
+	std::condition_variable			m_cvFree;							///< Signals a released chunk
+	std::thread						m_producer;							///< The producer thread
+};
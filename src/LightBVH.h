@@ -0,0 +1,152 @@
+// Light Bounding Volume Hierarchy class for many-light sampling
+#pragma once
+
+#include "ILight.h"
+
+// ================================ Light BVH Class ================================
+/**
+ * @brief Light Bounding Volume Hierarchy (BVH) class
+ * @details The hierarchy is built over the spatial bounds and the power of the scene light sources.
+ * It allows to pick a light source for a shading point with probability proportional to an estimate of its contribution
+ * in O(log n) time, where n is the number of light sources. Since every light source is picked with a non-zero probability,
+ * dividing the light contribution by the returned probability yields an unbiased estimate of the contribution of all the lights.
+ */
+class CLightBVH
+{
+public:
+	CLightBVH(void) = default;
+	CLightBVH(const CLightBVH&) = delete;
+	~CLightBVH(void) = default;
+	const CLightBVH& operator=(const CLightBVH&) = delete;
+
+	/**
+	 * @brief Builds the light hierarchy for the light sources provided via \b vpLights
+	 * @param vpLights The vector of pointers to the light sources in the scene
+	 */
+	void build(const std::vector<ptr_light_t>& vpLights)
+	{
+		m_vpLights = vpLights;
+		m_vNodes.clear();
+		if (m_vpLights.empty()) return;
+		m_vNodes.reserve(2 * m_vpLights.size() - 1);
+
+		std::vector<size_t> vIdx(m_vpLights.size());
+		for (size_t i = 0; i < vIdx.size(); i++) vIdx[i] = i;
+		build(vIdx.begin(), vIdx.end());
+	}
+	/**
+	 * @brief Picks a light source for illuminating point \b p
+	 * @param p The point to be illuminated
+	 * @param u A uniformly distributed random number in range [0; 1)
+	 * @returns The pair containing the pointer to the picked light source and the probability with which it was picked
+	 */
+	std::pair<ptr_light_t, float> sample(const Vec3f& p, float u) const
+	{
+		if (m_vNodes.empty()) return std::make_pair(nullptr, 0.0f);
+
+		float pdf = 1.0f;
+		size_t n = 0;
+		while (!m_vNodes[n].isLeaf()) {
+			const Node& left = m_vNodes[n + 1];
+			const Node& right = m_vNodes[m_vNodes[n].right];
+			float wLeft = left.importance(p);
+			float wRight = right.importance(p);
+			float pLeft = (wLeft + wRight > 0) ? wLeft / (wLeft + wRight) : 0.5f;
+			if (u < pLeft) {
+				u = u / pLeft;
+				pdf *= pLeft;
+				n = n + 1;
+			} else {
+				u = MIN((u - pLeft) / (1 - pLeft), 1.0f - std::numeric_limits<float>::epsilon());
+				pdf *= 1 - pLeft;
+				n = m_vNodes[n].right;
+			}
+		}
+		return std::make_pair(m_vpLights[m_vNodes[n].light], pdf);
+	}
+	/**
+	 * @brief Returns the number of light sources in the hierarchy
+	 * @returns The number of light sources in the hierarchy
+	 */
+	size_t size(void) const { return m_vpLights.size(); }
+
+
+private:
+	/// Light BVH node, stored in depth-first order: the left child of a branch node immediately follows its parent
+	struct Node
+	{
+		CBoundingBox	box;		///< The bounds of all the light sources in the sub-tree
+		float			power;		///< The total power of all the light sources in the sub-tree
+		size_t			right;		///< The index of the right child (branch nodes only)
+		size_t			light;		///< The index of the light source (leaf nodes only)
+
+		bool isLeaf(void) const { return right == 0; }
+		/**
+		 * @brief Estimates the contribution of the sub-tree to point \b p
+		 * @details The squared distance is clamped from below with the squared half-diagonal of the node (and with the \b Epsilon for the point lights),
+		 * which keeps the importance finite for points inside the bounds and keeps it conservative for the large nodes
+		 */
+		float importance(const Vec3f& p) const
+		{
+			if (power <= 0) return 0;
+			Vec3f diag = box.getMaxPoint() - box.getMinPoint();
+			if (isinf(diag.val[0]) || isinf(diag.val[1]) || isinf(diag.val[2])) return power;
+			Vec3f center = 0.5f * (box.getMinPoint() + box.getMaxPoint());
+			float dist2 = (p - center).dot(p - center);
+			float radius2 = MAX(0.25f * diag.dot(diag), Epsilon * Epsilon);
+			return power / MAX(dist2, radius2);
+		}
+	};
+
+	/**
+	 * @brief Builds the hierarchy recursively
+	 * @details The lights are split at the median of their centers along the widest dimension of the centers' bounds
+	 * @returns The index of the created node
+	 */
+	size_t build(std::vector<size_t>::iterator begin, std::vector<size_t>::iterator end)
+	{
+		size_t res = m_vNodes.size();
+		m_vNodes.push_back(Node{ CBoundingBox(), 0, 0, 0 });
+
+		CBoundingBox box;
+		CBoundingBox centers;
+		float power = 0;
+		for (auto it = begin; it != end; it++) {
+			CBoundingBox lightBox = m_vpLights[*it]->getBoundingBox();
+			box.extend(lightBox);
+			centers.extend(centerOf(lightBox));
+			power += MAX(0.0f, m_vpLights[*it]->getPower());
+		}
+		m_vNodes[res].box = box;
+		m_vNodes[res].power = power;
+
+		if (end - begin == 1) {
+			m_vNodes[res].light = *begin;
+			return res;
+		}
+
+		Vec3f extent = centers.getMaxPoint() - centers.getMinPoint();
+		int dim = (extent.val[0] > extent.val[1]) ? ((extent.val[0] > extent.val[2]) ? 0 : 2) : ((extent.val[1] > extent.val[2]) ? 1 : 2);
+		auto middle = begin + (end - begin) / 2;
+		std::nth_element(begin, middle, end, [&](size_t a, size_t b) {
+			return centerOf(m_vpLights[a]->getBoundingBox()).val[dim] < centerOf(m_vpLights[b]->getBoundingBox()).val[dim];
+		});
+
+		build(begin, middle);
+		m_vNodes[res].right = build(middle, end);
+		return res;
+	}
+
+	static Vec3f centerOf(const CBoundingBox& box)
+	{
+		Vec3f res = 0.5f * (box.getMinPoint() + box.getMaxPoint());
+		for (int i = 0; i < 3; i++)
+			if (isnan(res.val[i])) res.val[i] = 0;		// infinite bounds
+		return res;
+	}
+
+
+private:
+	std::vector<ptr_light_t>	m_vpLights;		///< The light sources
+	std::vector<Node>			m_vNodes;		///< The hierarchy nodes
+};
@@ -29,9 +29,11 @@ public:
 		ray.t = norm(ray.dir);
 		ray.dir = normalize(ray.dir);
 		ray.hit = nullptr;
-		double attenuation = 1 / (ray.t * ray.t);
+		float attenuation = 1 / (ray.t * ray.t);
 		return attenuation * m_intensity;
 	}
+	virtual CBoundingBox getBoundingBox(void) const override { return CBoundingBox(m_org, m_org); }
+	virtual float getPower(void) const override { return (m_intensity.val[0] + m_intensity.val[1] + m_intensity.val[2]) / 3; }
 
 
 private:
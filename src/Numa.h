@@ -0,0 +1,208 @@
+// NUMA Placement class
+#pragma once
+
+#include "types.h"
+#include <atomic>
+#include <array>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#ifdef ENABLE_NUMA
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Placement of the scene data on the NUMA nodes
+enum class NumaMode {
+	off,			///< The threads are not pinned and the memory is placed by the operating system
+	replicate,		///< The threads are pinned per node and every node traverses its own copy of the BSP tree
+	interleave		///< The threads are pinned per node and the scene memory is interleaved page by page over the nodes
+};
+
+// ================================ NUMA Placement Class ================================
+/**
+ * @brief NUMA placement class
+ * @details On a multi-socket machine a thread reaches the memory of its own node faster than the memory of the other nodes.
+ * The rendering threads are pinned to the nodes in turn (Ref. pinThread()), and the scene data is either replicated per node (the memory
+ * of a BSP tree, built by a thread on a node, is allocated on that node) or interleaved over all the nodes, so that every thread sees the
+ * same average latency instead of the remote latency for half of the threads. The number of primary rays and the time spent per node
+ * are accumulated for the throughput report (Ref. printSummary()).
+ * The topology is read from \a /sys/devices/system/node. A machine with one node may be split into several emulated nodes: the threads
+ * are pinned to the parts of its CPUs and the trees are replicated, while the memory placement stays unchanged.
+ * @note NUMA support is compiled in only if ENABLE_NUMA is defined. Otherwise the machine is treated as one node and the threads are not pinned
+ */
+class CNuma
+{
+public:
+	/**
+	 * @brief Initializes the placement
+	 * @details In the interleave mode the memory policy of the calling thread is set to interleave, thus the scene should be created
+	 * by the calling thread afterwards. It must be called before the rendering threads are started
+	 * @param mode The placement mode
+	 * @param nEmulatedNodes The number of nodes to be emulated, if the machine has less nodes. Zero value uses the nodes of the machine
+	 */
+	static void init(NumaMode mode, size_t nEmulatedNodes = 0)
+	{
+		m_mode = mode;
+		m_vvCpus.clear();
+#ifdef ENABLE_NUMA
+		for (size_t node = 0; node < maxNodes; node++) {
+			std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+			std::string list;
+			if (!file.is_open() || !getline(file, list)) break;
+			std::vector<int> vCpus = parseCpuList(list);
+			if (!vCpus.empty()) m_vvCpus.push_back(vCpus);
+		}
+#endif
+		m_nPhysicalNodes = MAX(size_t(1), m_vvCpus.size());
+		if (m_vvCpus.empty()) {
+			m_vvCpus.emplace_back();
+			for (int cpu = 0; cpu < static_cast<int>(MAX(1u, std::thread::hardware_concurrency())); cpu++) m_vvCpus.back().push_back(cpu);
+		}
+		if (nEmulatedNodes > m_vvCpus.size()) {
+			// the CPUs of all the nodes are split evenly; if there are less CPUs than nodes, the nodes share the CPUs
+			std::vector<int> vCpus;
+			for (const auto& v : m_vvCpus) vCpus.insert(vCpus.end(), v.begin(), v.end());
+			nEmulatedNodes = MIN(nEmulatedNodes, maxNodes);
+			m_vvCpus.assign(nEmulatedNodes, std::vector<int>());
+			if (vCpus.size() < nEmulatedNodes)
+				for (size_t node = 0; node < nEmulatedNodes; node++) m_vvCpus[node].push_back(vCpus[node % vCpus.size()]);
+			else
+				for (size_t i = 0; i < vCpus.size(); i++) m_vvCpus[i * nEmulatedNodes / vCpus.size()].push_back(vCpus[i]);
+		}
+
+#ifdef ENABLE_NUMA
+		if (mode == NumaMode::interleave && m_nPhysicalNodes > 1) {
+			const unsigned long mask = m_nPhysicalNodes < 64 ? (1UL << m_nPhysicalNodes) - 1 : ~0UL;
+			if (syscall(SYS_set_mempolicy, m_mpolInterleave, &mask, m_nPhysicalNodes + 1) != 0)
+				printf("WARNING: Can't interleave the memory over the NUMA nodes\n");
+		}
+#endif
+		for (auto& stats : m_stats) {
+			stats.nThreads = 0;
+			stats.nRays = 0;
+			stats.time = 0;
+		}
+		printf("NUMA: %zu node(s)%s, %s mode\n", m_vvCpus.size(), m_vvCpus.size() > m_nPhysicalNodes ? " (emulated)" : "",
+			mode == NumaMode::replicate ? "replicate" : mode == NumaMode::interleave ? "interleave" : "off");
+	}
+	/**
+	 * @brief Returns the placement mode
+	 * @returns The placement mode
+	 */
+	static NumaMode getMode(void) { return m_mode; }
+	/**
+	 * @brief Returns the number of nodes
+	 * @returns The number of the (possibly emulated) nodes, at least one
+	 */
+	static size_t getNumNodes(void) { return MAX(size_t(1), m_vvCpus.size()); }
+	/**
+	 * @brief Returns the node of the calling thread
+	 * @returns The node, the calling thread is pinned to, or zero if it is not pinned
+	 */
+	static size_t getNode(void) { return m_node; }
+	/**
+	 * @brief Pins the calling thread to the CPUs of node \b node
+	 * @param node The node
+	 * @retval true If the thread was pinned
+	 * @retval false Otherwise
+	 */
+	static bool pinThread(size_t node)
+	{
+		if (node >= m_vvCpus.size()) return false;
+#ifdef ENABLE_NUMA
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu : m_vvCpus[node]) CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) != 0) return false;
+#endif
+		m_node = node;
+		m_pinned = true;
+		return true;
+	}
+	/**
+	 * @brief Pins the calling thread to the next node in turn, unless the placement is off or the thread was already given its node
+	 * @details It is called by the rendering threads of the pool before they render, thus they are distributed evenly over the nodes.
+	 * Every thread tries to be pinned once; a thread, which can not be pinned, stays unpinned and is not counted.
+	 * The thread, which starts the render, is not pinned (Ref. IRenderer::render()), thus its later serial work may use all the CPUs
+	 */
+	static void pinThread(void)
+	{
+		if (m_mode == NumaMode::off || m_pinAttempted) return;
+		m_pinAttempted = true;
+		if (pinThread(m_nextNode++ % getNumNodes())) m_stats[m_node].nThreads++;
+	}
+	/**
+	 * @brief Accounts the primary rays, traced by the calling thread, to its node
+	 * @note The rays of the unpinned threads are not accounted
+	 * @param nRays The number of rays
+	 * @param time The time in seconds
+	 */
+	static void addRays(size_t nRays, double time)
+	{
+		if (m_mode == NumaMode::off || !m_pinned) return;
+		Stats& stats = m_stats[m_node];
+		stats.nRays += nRays;
+		stats.time += static_cast<qword>(time * 1e9);
+	}
+	/**
+	 * @brief Prints the throughput of every node
+	 * @details The throughput of a node is the number of its primary rays per second of the time, its threads spent rendering
+	 */
+	static void printSummary(void)
+	{
+		if (m_mode == NumaMode::off) return;
+		for (size_t node = 0; node < getNumNodes(); node++) {
+			const Stats& stats = m_stats[node];
+			const double time = 1e-9 * stats.time;
+			printf("NUMA node %zu: %zu CPUs, %zu threads, %.2f MRays, %.3f MRays/s per thread\n", node, m_vvCpus[node].size(),
+				static_cast<size_t>(stats.nThreads), 1e-6 * stats.nRays, time > 0 ? 1e-6 * stats.nRays / time : 0.0);
+		}
+	}
+
+
+public:
+	static constexpr size_t maxNodes = 64;		///< The maximal number of nodes
+
+
+private:
+	/// Throughput counters of a node
+	struct Stats
+	{
+		Stats(void) : nThreads(0), nRays(0), time(0) {}
+
+		std::atomic<size_t>	nThreads;		///< The number of threads, pinned to the node
+		std::atomic<qword>	nRays;			///< The number of primary rays
+		std::atomic<qword>	time;			///< The rendering time of the threads in nanoseconds
+	};
+
+	// Parses the Linux CPU list format, e.g. "0-3,8-11"
+	static std::vector<int> parseCpuList(const std::string& list)
+	{
+		std::vector<int> res;
+		std::stringstream ss(list);
+		std::string range;
+		while (getline(ss, range, ',')) {
+			int first = 0;
+			int last = 0;
+			int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+			if (n < 1) continue;
+			if (n == 1) last = first;
+			for (int cpu = first; cpu <= last; cpu++) res.push_back(cpu);
+		}
+		return res;
+	}
+
+
+private:
+	static constexpr int								m_mpolInterleave = 3;	///< MPOL_INTERLEAVE of the Linux memory policy API
+	static inline NumaMode								m_mode = NumaMode::off;	///< The placement mode
+	static inline std::vector<std::vector<int>>			m_vvCpus;				///< The CPUs of every node
+	static inline size_t								m_nPhysicalNodes = 1;	///< The number of the nodes of the machine
+	static inline std::atomic<size_t>					m_nextNode{ 0 };		///< The node of the next pinned thread
+	static inline std::array<Stats, maxNodes>			m_stats;				///< The throughput counters per node
+	static inline thread_local size_t					m_node = 0;				///< The node of the calling thread
+	static inline thread_local bool						m_pinned = false;		///< Whether the calling thread is pinned
+	static inline thread_local bool						m_pinAttempted = false;	///< Whether the calling thread was given its node by pinThread()
+};
@@ -0,0 +1,503 @@
+// Out-of-core Mesh class
+#pragma once
+
+#include "BSPTree.h"
+#include "PrimTriangle.h"
+#include "InputStream.h"
+#include <fstream>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+
+// ================================ Out-of-core Mesh Class ================================
+/**
+ * @brief Out-of-core triangle mesh class
+ * @details The mesh is pre-partitioned into spatial clusters on disk (Ref. partition()). Only the small cluster index and
+ * a hierarchy over the cluster bounds stay resident; the triangles of a cluster together with its local BSP tree are paged in
+ * on demand and kept in a LRU cache, which is limited by the memory budget. The rays are intersected in batches (Ref. intersect()):
+ * every ray is queued to all the clusters it passes through, and the queues are processed cluster by cluster, so that every
+ * cluster is paged in at most once per batch, no matter how many rays hit it.
+ * The vertex positions are stored on disk as 16-bit offsets from the cluster origin on a lattice, which is common for all the clusters.
+ * Thus a vertex shared by several clusters is restored to exactly the same position in every one of them and the mesh stays watertight.
+ * The vertices are rounded to the nearest lattice point, while the cluster bounds are rounded conservatively (Ref. partition()).
+ * @note The memory budget is soft: the clusters, which are being intersected by other threads, are released only after they are done
+ */
+class COutOfCoreMesh
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @details Opens the partitioned mesh and builds the hierarchy over the cluster bounds
+	 * @param pShader Pointer to the shader to be applied for the mesh triangles
+	 * @param path The directory with the partitioned mesh (Ref. partition())
+	 * @param memoryBudget The maximum memory in bytes, which may be occupied by the resident clusters
+	 */
+	COutOfCoreMesh(ptr_shader_t pShader, const std::string& path, size_t memoryBudget)
+		: m_pShader(pShader)
+		, m_path(path)
+		, m_memoryBudget(memoryBudget)
+	{
+		std::ifstream file(indexFileName(path), std::ios::binary);
+		dword header[3] = { 0, 0, 0 };
+		if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != m_magic || header[1] != m_version) {
+			std::cout << "ERROR: Can't open the partitioned mesh " << path << std::endl;
+			return;
+		}
+		float lattice[4];
+		file.read(reinterpret_cast<char*>(lattice), sizeof(lattice));
+		m_origin = Vec3f(lattice[0], lattice[1], lattice[2]);
+		m_step = lattice[3];
+		m_vClusters.resize(header[2]);
+		for (Cluster& cluster : m_vClusters) {
+			float bounds[6];
+			file.read(reinterpret_cast<char*>(bounds), sizeof(bounds));
+			file.read(reinterpret_cast<char*>(&cluster.nTriangles), sizeof(cluster.nTriangles));
+			file.read(reinterpret_cast<char*>(cluster.base.val), sizeof(cluster.base.val));
+			cluster.box = CBoundingBox(Vec3f(bounds[0], bounds[1], bounds[2]), Vec3f(bounds[3], bounds[4], bounds[5]));
+			m_box.extend(cluster.box);
+		}
+		if (!file) {
+			std::cout << "ERROR: The cluster index of " << path << " is corrupted" << std::endl;
+			m_vClusters.clear();
+			m_box = CBoundingBox();
+			return;
+		}
+
+		if (!m_vClusters.empty()) {
+			std::vector<size_t> vIdx(m_vClusters.size());
+			for (size_t i = 0; i < vIdx.size(); i++) vIdx[i] = i;
+			m_vNodes.reserve(2 * m_vClusters.size() - 1);
+			build(vIdx.begin(), vIdx.end());
+		}
+		std::cout << "Opened out-of-core mesh with " << m_vClusters.size() << " clusters, bounds are : " << m_box << std::endl;
+	}
+	COutOfCoreMesh(const COutOfCoreMesh&) = delete;
+	~COutOfCoreMesh(void) = default;
+	const COutOfCoreMesh& operator=(const COutOfCoreMesh&) = delete;
+
+	/**
+	 * @brief Partitions an .obj file into spatial clusters on disk
+	 * @details The triangles are streamed into the cells of a uniform grid by their centroids. The grid is chosen such that a cell holds
+	 * about \b clusterSize triangles on average. The polygon faces are split into triangle fans, the triangles of a face are assigned to the cells independently.
+	 * Only the vertex positions and the write buffers of the cells are kept in memory.
+	 * Finally the vertices are quantized to the lattice, whose step is fine enough to address the largest cluster with 16 bits.
+	 * @param fileName The full path to the .obj file, which may be gzip or zstd compressed (Ref. CInputStream)
+	 * @param path The directory, where the clusters are to be written. It must exist
+	 * @param clusterSize The average number of triangles per cluster
+	 * @param scale The scale factor, applied to the vertex positions
+	 * @retval true If the mesh was partitioned successfully
+	 * @retval false Otherwise
+	 */
+	static bool partition(const std::string& fileName, const std::string& path, size_t clusterSize = 65536, float scale = 1)
+	{
+		// Pass 1: read the vertices and count the faces
+		std::vector<Vec3f> vVertexes;
+		CBoundingBox box;
+		size_t nFaces = 0;
+		{
+			CInputStream file(fileName);
+			if (!file.is_open()) {
+				std::cout << "ERROR: Can't open OBJFile " << fileName << std::endl;
+				return false;
+			}
+			std::cout << "Partitioning OBJFile : " << fileName << std::endl;
+			std::string line;
+			while (getline(file, line)) {
+				if (line.compare(0, 2, "v ") == 0) {
+					Vec3f v;
+					std::stringstream ss(line.substr(2));
+					for (int i = 0; i < 3; i++) ss >> v.val[i];
+					vVertexes.push_back(scale * v);
+					box.extend(vVertexes.back());
+				}
+				else if (line.compare(0, 2, "f ") == 0) nFaces++;
+			}
+		}
+		if (nFaces == 0) {
+			std::cout << "ERROR: OBJFile " << fileName << " contains no faces" << std::endl;
+			return false;
+		}
+
+		// Choose the grid: split the longest cell edge until there are enough cells
+		const Vec3f extent = box.getMaxPoint() - box.getMinPoint();
+		const size_t nCells = std::max<size_t>(1, (nFaces + clusterSize - 1) / std::max<size_t>(1, clusterSize));
+		Vec3i dims(1, 1, 1);
+		while (static_cast<size_t>(dims[0]) * dims[1] * dims[2] < nCells) {
+			Vec3f cell(extent.val[0] / dims[0], extent.val[1] / dims[1], extent.val[2] / dims[2]);
+			dims[MaxDim(cell)] *= 2;
+		}
+		auto cellOf = [&](const Vec3f& p) {
+			size_t res = 0;
+			for (int i = 2; i >= 0; i--) {
+				int c = extent.val[i] > 0 ? static_cast<int>(dims[i] * (p.val[i] - box.getMinPoint().val[i]) / extent.val[i]) : 0;
+				res = res * dims[i] + static_cast<size_t>(MIN(MAX(c, 0), dims[i] - 1));
+			}
+			return res;
+		};
+
+		// Pass 2: stream the triangles into the cells
+		const size_t nTotalCells = static_cast<size_t>(dims[0]) * dims[1] * dims[2];
+		std::vector<std::vector<float>> vBuffers(nTotalCells);
+		std::vector<Cluster> vCells(nTotalCells);
+		for (size_t c = 0; c < nTotalCells; c++)
+			std::ofstream(clusterFileName(path, c), std::ios::binary | std::ios::trunc);
+		auto flush = [&](size_t c) {
+			std::ofstream file(clusterFileName(path, c), std::ios::binary | std::ios::app);
+			file.write(reinterpret_cast<const char*>(vBuffers[c].data()), vBuffers[c].size() * sizeof(float));
+			vBuffers[c].clear();
+			return static_cast<bool>(file);
+		};
+		size_t nTriangles = 0;
+		{
+			CInputStream file(fileName);
+			std::string line;
+			std::vector<Vec3f> vPolygon;		// the vertices of the current face
+			while (getline(file, line)) {
+				if (line.compare(0, 2, "f ") != 0) continue;
+				std::stringstream ss(line.substr(2));
+				vPolygon.clear();
+				bool valid = true;
+				std::string token;
+				while (ss >> token) {
+					int idx = atoi(token.c_str());
+					if (idx < 0) idx += static_cast<int>(vVertexes.size()) + 1;		// relative index
+					if (idx < 1 || idx > static_cast<int>(vVertexes.size())) valid = false;
+					else vPolygon.push_back(vVertexes[idx - 1]);
+				}
+				if (!valid || vPolygon.size() < 3) continue;
+
+				for (size_t k = 1; k + 1 < vPolygon.size(); k++) {
+					const Vec3f v[3] = { vPolygon[0], vPolygon[k], vPolygon[k + 1] };
+					size_t c = cellOf((v[0] + v[1] + v[2]) / 3.0f);
+					for (int i = 0; i < 3; i++) {
+						vBuffers[c].insert(vBuffers[c].end(), v[i].val, v[i].val + 3);
+						vCells[c].box.extend(v[i]);
+					}
+					vCells[c].nTriangles++;
+					nTriangles++;
+					if (vBuffers[c].size() >= m_flushSize && !flush(c)) return false;
+				}
+			}
+		}
+		for (size_t c = 0; c < nTotalCells; c++)
+			if (!vBuffers[c].empty() && !flush(c)) return false;
+
+		// Choose the lattice
+		const Vec3f origin = box.getMinPoint();
+		float maxExtent = 0;
+		for (const Cluster& cell : vCells)
+			if (cell.nTriangles > 0)
+				for (int i = 0; i < 3; i++)
+					maxExtent = MAX(maxExtent, cell.box.getMaxPoint().val[i] - cell.box.getMinPoint().val[i]);
+		const float step = maxExtent > 0 ? maxExtent / (std::numeric_limits<word>::max() - 2) : 1.0f;
+
+		// Pass 3: quantize the non-empty cells, renumbering their files
+		std::vector<Cluster> vClusters;
+		for (size_t c = 0; c < nTotalCells; c++) {
+			if (vCells[c].nTriangles == 0) {
+				std::remove(clusterFileName(path, c).c_str());
+				continue;
+			}
+			Cluster cluster;
+			cluster.nTriangles = vCells[c].nTriangles;
+			for (int i = 0; i < 3; i++)
+				cluster.base[i] = static_cast<int>(std::floor((vCells[c].box.getMinPoint().val[i] - origin.val[i]) / step));
+
+			std::vector<float> vBuffer(9 * static_cast<size_t>(cluster.nTriangles));
+			std::vector<word> vQuantized(vBuffer.size());
+			std::ifstream(clusterFileName(path, c), std::ios::binary).read(reinterpret_cast<char*>(vBuffer.data()), vBuffer.size() * sizeof(float));
+			for (size_t i = 0; i < vBuffer.size(); i++) {
+				int k = static_cast<int>(i % 3);
+				long q = std::lround((vBuffer[i] - origin.val[k]) / step) - cluster.base[k];
+				vQuantized[i] = static_cast<word>(MIN(MAX(q, 0L), static_cast<long>(std::numeric_limits<word>::max())));
+			}
+			// the bounds are rounded conservatively: they enclose both the original and the quantized triangles with the margin of half a step,
+			// thus no triangle moves out of its cluster bounds, and the rays, passing the cluster borders, do not miss it
+			for (size_t i = 0; i < vQuantized.size(); i += 3)
+				cluster.box.extend(dequantize(origin, step, cluster.base, &vQuantized[i]));
+			cluster.box.extend(vCells[c].box);
+			const Vec3f margin(0.5f * step, 0.5f * step, 0.5f * step);
+			cluster.box = CBoundingBox(cluster.box.getMinPoint() - margin, cluster.box.getMaxPoint() + margin);
+
+			std::remove(clusterFileName(path, c).c_str());
+			std::ofstream file(clusterFileName(path, vClusters.size()), std::ios::binary | std::ios::trunc);
+			if (!file.write(reinterpret_cast<const char*>(vQuantized.data()), vQuantized.size() * sizeof(word))) return false;
+			vClusters.push_back(cluster);
+		}
+
+		// Write the index
+		std::ofstream file(indexFileName(path), std::ios::binary | std::ios::trunc);
+		dword header[3] = { m_magic, m_version, static_cast<dword>(vClusters.size()) };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		float lattice[4] = { origin[0], origin[1], origin[2], step };
+		file.write(reinterpret_cast<const char*>(lattice), sizeof(lattice));
+		for (const Cluster& cluster : vClusters) {
+			Vec3f minPoint = cluster.box.getMinPoint();
+			Vec3f maxPoint = cluster.box.getMaxPoint();
+			float bounds[6] = { minPoint[0], minPoint[1], minPoint[2], maxPoint[0], maxPoint[1], maxPoint[2] };
+			file.write(reinterpret_cast<const char*>(bounds), sizeof(bounds));
+			file.write(reinterpret_cast<const char*>(&cluster.nTriangles), sizeof(cluster.nTriangles));
+			file.write(reinterpret_cast<const char*>(cluster.base.val), sizeof(cluster.base.val));
+		}
+		std::cout << "Partitioned " << nFaces << " faces (" << nTriangles << " triangles) into " << vClusters.size() << " clusters" << std::endl;
+		return static_cast<bool>(file);
+	}
+
+	/**
+	 * @brief Finds the closest intersection of every ray of the batch \b vRays with the mesh
+	 * @details The rays are queued to the clusters they pass through. The resident clusters are processed first, the rest are paged in
+	 * one after another, the ones with the longest queues first. A ray is intersected with a cluster only if the cluster
+	 * is entered before the closest hit found so far. This method is thread-safe.
+	 * @param vRays The batch of rays. If a ray hits the mesh closer than \b ray.t, its \b t and \b hit fields are updated
+	 */
+	void intersect(std::vector<Ray>& vRays) const
+	{
+		std::vector<std::vector<QueueEntry>> vQueues(m_vClusters.size());
+		for (size_t r = 0; r < vRays.size(); r++)
+			traverse(vRays[r], [&](size_t c, float t0) { vQueues[c].push_back(QueueEntry{ r, t0 }); });
+
+		std::vector<size_t> vOrder;
+		std::vector<bool> vResident(m_vClusters.size(), false);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t c = 0; c < m_vClusters.size(); c++) {
+				if (vQueues[c].empty()) continue;
+				vResident[c] = m_vClusters[c].pData != nullptr;
+				vOrder.push_back(c);
+			}
+		}
+		std::sort(vOrder.begin(), vOrder.end(), [&](size_t a, size_t b) {
+			if (vResident[a] != vResident[b]) return static_cast<bool>(vResident[a]);
+			return vQueues[a].size() != vQueues[b].size() ? vQueues[a].size() > vQueues[b].size() : a < b;
+		});
+
+		for (size_t c : vOrder) {
+			std::shared_ptr<const ClusterData> pData;
+			for (const QueueEntry& entry : vQueues[c]) {
+				Ray& ray = vRays[entry.index];
+				if (entry.t0 >= ray.t) continue;
+				if (!pData) pData = acquire(c);
+				pData->tree.intersect(ray);
+			}
+		}
+	}
+	/**
+	 * @brief Finds the closest intersection of the ray \b ray with the mesh
+	 * @details The clusters are visited in the order of their entry distances and paged in one at a time on demand.
+	 * Use the batched version for many rays. This method is thread-safe.
+	 * @param ray The ray. If it hits the mesh closer than \b ray.t, its \b t and \b hit fields are updated
+	 * @retval true If the ray hits the mesh closer than \b ray.t
+	 * @retval false Otherwise
+	 */
+	bool intersect(Ray& ray) const
+	{
+		std::vector<QueueEntry> vEntries;
+		traverse(ray, [&](size_t c, float t0) { vEntries.push_back(QueueEntry{ c, t0 }); });
+		std::sort(vEntries.begin(), vEntries.end(), [](const QueueEntry& a, const QueueEntry& b) { return a.t0 < b.t0; });
+
+		bool res = false;
+		for (const QueueEntry& entry : vEntries) {
+			if (entry.t0 >= ray.t) break;
+			res |= acquire(entry.index)->tree.intersect(ray);
+		}
+		return res;
+	}
+	/**
+	 * @brief Returns the bounding box of the mesh
+	 * @returns The bounding box of all the clusters
+	 */
+	CBoundingBox getBoundingBox(void) const { return m_box; }
+	/**
+	 * @brief Returns the number of the clusters
+	 * @returns The number of the clusters
+	 */
+	size_t getNumClusters(void) const { return m_vClusters.size(); }
+	/**
+	 * @brief Returns the number of times the clusters were paged in
+	 * @returns The number of the cluster loads
+	 */
+	size_t getNumLoads(void) const { return m_nLoads; }
+
+
+private:
+	/// The triangles of a cluster with their local BSP tree
+	struct ClusterData
+	{
+		std::vector<ptr_prim_t>		vpPrims;	///< The triangles of the cluster
+		CBSPTree					tree;		///< The local BSP tree of the cluster
+		size_t						size = 0;	///< The estimated memory footprint in bytes
+	};
+
+	/// Cluster index entry
+	struct Cluster
+	{
+		CBoundingBox							box;				///< The bounds of the cluster triangles
+		dword									nTriangles = 0;		///< The number of the triangles
+		Vec3i									base;				///< The origin of the cluster on the lattice
+		std::shared_ptr<const ClusterData>		pData;				///< The cluster data or nullptr if the cluster is not resident
+		std::list<size_t>::iterator				itLRU;				///< The position in the LRU list (resident clusters only)
+		bool									loading = false;	///< Whether the cluster is being paged in by a thread
+	};
+
+	/// Node of the hierarchy over the cluster bounds, stored in depth-first order (Ref. CLightBVH)
+	struct Node
+	{
+		CBoundingBox	box;		///< The bounds of all the clusters in the sub-tree
+		size_t			right;		///< The index of the right child (branch nodes only)
+		size_t			cluster;	///< The index of the cluster (leaf nodes only)
+
+		bool isLeaf(void) const { return right == 0; }
+	};
+
+	/// Cluster queue entry of a ray
+	struct QueueEntry
+	{
+		size_t	index;		///< The index of the ray in the batch (or of the cluster for the single-ray queries)
+		float	t0;			///< The distance at which the ray enters the cluster
+	};
+
+	size_t build(std::vector<size_t>::iterator begin, std::vector<size_t>::iterator end)
+	{
+		size_t res = m_vNodes.size();
+		m_vNodes.push_back(Node{ CBoundingBox(), 0, 0 });
+
+		CBoundingBox box;
+		CBoundingBox centers;
+		for (auto it = begin; it != end; it++) {
+			box.extend(m_vClusters[*it].box);
+			centers.extend(centerOf(m_vClusters[*it].box));
+		}
+		m_vNodes[res].box = box;
+
+		if (end - begin == 1) {
+			m_vNodes[res].cluster = *begin;
+			return res;
+		}
+
+		int dim = MaxDim(centers.getMaxPoint() - centers.getMinPoint());
+		auto middle = begin + (end - begin) / 2;
+		std::nth_element(begin, middle, end, [&](size_t a, size_t b) {
+			return centerOf(m_vClusters[a].box).val[dim] < centerOf(m_vClusters[b].box).val[dim];
+		});
+
+		build(begin, middle);
+		m_vNodes[res].right = build(middle, end);
+		return res;
+	}
+
+	// Calls visit(cluster, t0) for every cluster, whose bounds are entered by the ray before ray.t
+	template <class F>
+	void traverse(const Ray& ray, F visit) const
+	{
+		if (m_vNodes.empty()) return;
+		std::vector<size_t> vStack(1, 0);
+		while (!vStack.empty()) {
+			const Node& node = m_vNodes[vStack.back()];
+			size_t n = vStack.back();
+			vStack.pop_back();
+
+			float t0 = 0;
+			float t1 = ray.t;
+			node.box.clip(ray, t0, t1);
+			if (t1 < t0) continue;
+
+			if (node.isLeaf()) visit(node.cluster, t0);
+			else {
+				vStack.push_back(node.right);
+				vStack.push_back(n + 1);
+			}
+		}
+	}
+
+	// Returns the data of cluster c, paging it in if needed. The cluster is loaded outside of the lock, thus the other threads
+	// may use the resident clusters meanwhile; the threads, which need the same cluster, wait for it to be loaded
+	std::shared_ptr<const ClusterData> acquire(size_t c) const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		Cluster& cluster = m_vClusters[c];
+		m_cvLoaded.wait(lock, [&cluster] { return !cluster.loading; });
+		if (cluster.pData) {
+			m_lLRU.splice(m_lLRU.begin(), m_lLRU, cluster.itLRU);
+			return cluster.pData;
+		}
+		cluster.loading = true;
+		lock.unlock();
+
+		std::shared_ptr<const ClusterData> pData = load(c);
+
+		lock.lock();
+		cluster.loading = false;
+		m_nLoads++;
+
+		// evict the least recently used clusters
+		while (!m_lLRU.empty() && m_residentSize + pData->size > m_memoryBudget) {
+			Cluster& victim = m_vClusters[m_lLRU.back()];
+			m_residentSize -= victim.pData->size;
+			victim.pData = nullptr;
+			m_lLRU.pop_back();
+		}
+
+		cluster.pData = pData;
+		m_lLRU.push_front(c);
+		cluster.itLRU = m_lLRU.begin();
+		m_residentSize += pData->size;
+		lock.unlock();
+		m_cvLoaded.notify_all();
+		return pData;
+	}
+
+	// Reads the triangles of cluster c from the disk and builds their BSP tree
+	std::shared_ptr<ClusterData> load(size_t c) const
+	{
+		const Cluster& cluster = m_vClusters[c];
+		auto pData = std::make_shared<ClusterData>();
+		std::vector<word> vBuffer(9 * static_cast<size_t>(cluster.nTriangles));
+		std::ifstream file(clusterFileName(m_path, c), std::ios::binary);
+		if (!file.read(reinterpret_cast<char*>(vBuffer.data()), vBuffer.size() * sizeof(word)))
+			std::cout << "ERROR: Can't read the cluster file " << clusterFileName(m_path, c) << std::endl;
+		else {
+			pData->vpPrims.reserve(cluster.nTriangles);
+			for (size_t i = 0; i < vBuffer.size(); i += 9)
+				pData->vpPrims.push_back(std::make_shared<CPrimTriangle>(m_pShader,
+					dequantize(m_origin, m_step, cluster.base, &vBuffer[i]),
+					dequantize(m_origin, m_step, cluster.base, &vBuffer[i + 3]),
+					dequantize(m_origin, m_step, cluster.base, &vBuffer[i + 6])));
+			pData->tree.build(pData->vpPrims);
+		}
+		// the triangles with their control blocks, the pointers to them and the tree
+		pData->size = sizeof(ClusterData) + pData->vpPrims.size() * (sizeof(CPrimTriangle) + 16 + sizeof(ptr_prim_t)) + pData->tree.getMemoryUsage();
+		return pData;
+	}
+
+	// Restores the position of the vertex with the lattice coordinates base + q
+	static Vec3f dequantize(const Vec3f& origin, float step, const Vec3i& base, const word* q)
+	{
+		Vec3f res;
+		for (int i = 0; i < 3; i++)
+			res.val[i] = origin.val[i] + static_cast<float>(base.val[i] + q[i]) * step;
+		return res;
+	}
+	static Vec3f centerOf(const CBoundingBox& box) { return 0.5f * (box.getMinPoint() + box.getMaxPoint()); }
+	static std::string indexFileName(const std::string& path) { return path + "/clusters.idx"; }
+	static std::string clusterFileName(const std::string& path, size_t c) { return path + "/cluster_" + std::to_string(c) + ".bin"; }
+
+
+private:
+	static constexpr dword				m_magic = 0x434F4F45;		///< The signature of the cluster index file
+	static constexpr dword				m_version = 2;				///< The version of the cluster index file
+	static constexpr size_t				m_flushSize = 16384;		///< The size of the cell write buffers in floats
+
+	ptr_shader_t						m_pShader;					///< The shader of the mesh triangles
+	std::string							m_path;						///< The directory with the partitioned mesh
+	size_t								m_memoryBudget;				///< The memory budget of the resident clusters in bytes
+	CBoundingBox						m_box;						///< The bounds of the mesh
+	Vec3f								m_origin;					///< The origin of the vertex lattice
+	float								m_step = 1;					///< The step of the vertex lattice
+	std::vector<Node>					m_vNodes;					///< The hierarchy over the cluster bounds
+	mutable std::vector<Cluster>		m_vClusters;				///< The cluster index
+	mutable std::list<size_t>			m_lLRU;						///< The resident clusters, the most recently used first
+	mutable size_t						m_residentSize = 0;			///< The memory occupied by the resident clusters in bytes
+	mutable size_t						m_nLoads = 0;				///< The number of the cluster loads
+	mutable std::mutex					m_mutex;					///< Guards the cache
+	mutable std::condition_variable		m_cvLoaded;					///< Signals the threads, waiting for a cluster being paged in
+};
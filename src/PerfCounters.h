@@ -0,0 +1,283 @@
+// Hardware Performance Counters class
+#pragma once
+
+#include "types.h"
+#include <fstream>
+#include <mutex>
+#ifdef ENABLE_PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Profiled render stages
+enum class PerfStage { load, build, traversal, shading };
+
+// ================================ Performance Counters Class ================================
+/**
+ * @brief Hardware performance counters class
+ * @details Every thread owns a group of the Linux perf_event counters (cycles, instructions, cache misses and branch misses),
+ * which count the user-space events of that thread only. Thus no special privileges are required (up to \a perf_event_paranoid = 2).
+ * The counters are read at the beginning and at the end of every profiled scope (Ref. CPerfScope) and the differences are accumulated
+ * per thread and per stage. The counters, which can not be opened (e.g. in virtual machines), are reported as unavailable;
+ * the wall time of the stages is measured in any case.
+ * @note The counters are compiled in only if ENABLE_PERF_COUNTERS is defined. Otherwise the PERF_SCOPE() macro expands to nothing
+ */
+class CPerfCounters
+{
+public:
+	/// The hardware events
+	enum Event { cycles, instructions, cacheMisses, branchMisses, nEvents };
+
+	/// Counts of the events and the time, spent in a stage
+	struct Counts
+	{
+		std::array<qword, nEvents>	events = {};		///< The counts of the events
+		double						time = 0;			///< The wall time in milliseconds
+		size_t						calls = 0;			///< The number of the profiled scopes
+
+		Counts& operator+=(const Counts& rhs)
+		{
+			for (size_t e = 0; e < nEvents; e++) events[e] += rhs.events[e];
+			time += rhs.time;
+			calls += rhs.calls;
+			return *this;
+		}
+	};
+
+	CPerfCounters(const CPerfCounters&) = delete;
+	~CPerfCounters(void)
+	{
+#ifdef ENABLE_PERF_COUNTERS
+		for (int fd : m_fds)
+			if (fd >= 0) close(fd);
+#endif
+	}
+	const CPerfCounters& operator=(const CPerfCounters&) = delete;
+
+	/**
+	 * @brief Returns the counters of the calling thread
+	 * @details The counters are opened on the first call from the thread
+	 * @returns The reference to the counters of the calling thread
+	 */
+	static CPerfCounters& get(void)
+	{
+		static thread_local CPerfCounters counters;
+		return counters;
+	}
+	/**
+	 * @brief Reads the current values of the counters
+	 * @param[out] values The values of the available counters, scaled for multiplexing. The values of the unavailable counters are zero
+	 */
+	void read(std::array<qword, nEvents>& values) const
+	{
+		values.fill(0);
+#ifdef ENABLE_PERF_COUNTERS
+		if (m_leader < 0) return;
+		// PERF_FORMAT_GROUP layout: number of events, time enabled, time running, values
+		qword buf[3 + nEvents] = {};
+		if (::read(m_leader, buf, sizeof(buf)) < static_cast<ssize_t>(3 * sizeof(qword))) return;
+		double scale = buf[2] > 0 ? static_cast<double>(buf[1]) / buf[2] : 1.0;
+		size_t i = 0;
+		for (size_t e = 0; e < nEvents; e++)
+			if (m_fds[e] >= 0 && i < buf[0])
+				values[e] = static_cast<qword>(buf[3 + i++] * scale);
+#endif
+	}
+	/**
+	 * @brief Adds the counts of a profiled scope to the statistics of the calling thread
+	 * @param stage The stage of the scope
+	 * @param counts The counts of the scope
+	 */
+	void add(PerfStage stage, const Counts& counts) { m_pRecord->stages[static_cast<size_t>(stage)] += counts; }
+
+	/**
+	 * @brief Checks which events can be counted
+	 * @returns The flags of the events, which are available on this machine
+	 */
+	static std::array<bool, nEvents> getAvailability(void)
+	{
+		std::array<bool, nEvents> res;
+		for (size_t e = 0; e < nEvents; e++) res[e] = get().m_fds[e] >= 0;
+		return res;
+	}
+	/**
+	 * @brief Returns the statistics of a stage, summed up over all the threads
+	 * @param stage The stage
+	 * @returns The total counts of the stage
+	 */
+	static Counts getTotal(PerfStage stage)
+	{
+		Counts res;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto& pRecord : m_vpRecords) res += pRecord->stages[static_cast<size_t>(stage)];
+		return res;
+	}
+	/**
+	 * @brief Prints the summary table of all the stages and threads
+	 */
+	static void printSummary(void)
+	{
+		auto available = getAvailability();
+		auto field = [&](const Counts& c, Event e) { return available[e] ? format("%14llu", static_cast<unsigned long long>(c.events[e])) : format("%14s", "n/a"); };
+
+		printf("%-10s %6s %10s %14s %14s %6s %14s %14s\n", "Stage", "Thread", "Time, ms", "Cycles", "Instructions", "IPC", "Cache misses", "Branch misses");
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t s = 0; s < m_nStages; s++) {
+			Counts total;
+			for (const auto& pRecord : m_vpRecords) {
+				const Counts& c = pRecord->stages[s];
+				if (c.calls == 0) continue;
+				total += c;
+				printf("%-10s %6zu %10.2f %s %s %6s %s %s\n", m_stageNames[s], pRecord->thread, c.time,
+					field(c, cycles).c_str(), field(c, instructions).c_str(), ipc(c, available).c_str(), field(c, cacheMisses).c_str(), field(c, branchMisses).c_str());
+			}
+			if (total.calls == 0) continue;
+			printf("%-10s %6s %10.2f %s %s %6s %s %s\n", m_stageNames[s], "all", total.time,
+				field(total, cycles).c_str(), field(total, instructions).c_str(), ipc(total, available).c_str(), field(total, cacheMisses).c_str(), field(total, branchMisses).c_str());
+		}
+	}
+	/**
+	 * @brief Writes the statistics of all the stages and threads to a JSON file
+	 * @param fileName The full path to the report file
+	 * @retval true If the report was written successfully
+	 * @retval false Otherwise
+	 */
+	static bool writeReport(const std::string& fileName)
+	{
+		auto available = getAvailability();
+		auto events = [&](const Counts& c) {
+			std::string res;
+			for (size_t e = 0; e < nEvents; e++)
+				res += format(", \"%s\": ", m_eventNames[e]) + (available[e] ? std::to_string(c.events[e]) : "null");
+			return res;
+		};
+
+		std::ofstream file(fileName);
+		file << "{\n\t\"available\": {";
+		for (size_t e = 0; e < nEvents; e++)
+			file << (e ? ", " : "") << "\"" << m_eventNames[e] << "\": " << (available[e] ? "true" : "false");
+		file << "},\n\t\"stages\": [";
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		bool firstStage = true;
+		for (size_t s = 0; s < m_nStages; s++) {
+			Counts total;
+			std::string threads;
+			for (const auto& pRecord : m_vpRecords) {
+				const Counts& c = pRecord->stages[s];
+				if (c.calls == 0) continue;
+				total += c;
+				threads += format("%s\n\t\t\t\t{\"thread\": %zu, \"calls\": %zu, \"time_ms\": %.3f", threads.empty() ? "" : ",", pRecord->thread, c.calls, c.time) + events(c) + "}";
+			}
+			if (total.calls == 0) continue;
+			file << (firstStage ? "" : ",") << "\n\t\t{\n\t\t\t\"stage\": \"" << m_stageNames[s] << "\",\n";
+			file << format("\t\t\t\"total\": {\"calls\": %zu, \"time_ms\": %.3f", total.calls, total.time) << events(total) << "},\n";
+			file << "\t\t\t\"threads\": [" << threads << "\n\t\t\t]\n\t\t}";
+			firstStage = false;
+		}
+		file << "\n\t]\n}\n";
+		return static_cast<bool>(file);
+	}
+
+
+private:
+	CPerfCounters(void)
+	{
+		m_fds.fill(-1);
+#ifdef ENABLE_PERF_COUNTERS
+		const std::array<qword, nEvents> configs = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+		for (size_t e = 0; e < nEvents; e++) {
+			perf_event_attr attr = {};
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = configs[e];
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			// the calling thread on any CPU; the first available event leads the group
+			m_fds[e] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, m_leader, 0));
+			if (m_fds[e] >= 0 && m_leader < 0) m_leader = m_fds[e];
+		}
+#endif
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pRecord = std::make_shared<Record>();
+		m_pRecord->thread = m_vpRecords.size();
+		m_vpRecords.push_back(m_pRecord);
+	}
+
+	static std::string ipc(const Counts& c, const std::array<bool, nEvents>& available)
+	{
+		return available[cycles] && available[instructions] && c.events[cycles] > 0
+			? format("%6.2f", static_cast<double>(c.events[instructions]) / c.events[cycles]) : format("%6s", "n/a");
+	}
+
+
+private:
+	static constexpr size_t											m_nStages = 4;
+	static constexpr const char*									m_stageNames[m_nStages] = { "load", "build", "traversal", "shading" };
+	static constexpr const char*									m_eventNames[nEvents] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+
+	/// Statistics of a thread. The records outlive the threads, thus they are kept by the registry
+	struct Record
+	{
+		size_t								thread;		///< The index of the thread in order of the first use of the counters
+		std::array<Counts, m_nStages>		stages;		///< The statistics of the stages
+	};
+
+	static inline std::mutex										m_mutex;		///< Guards the registry
+	static inline std::vector<std::shared_ptr<Record>>				m_vpRecords;	///< The registry of the statistics of all the threads
+
+	std::array<int, nEvents>										m_fds;			///< The file descriptors of the counters or -1 if unavailable
+	int																m_leader = -1;	///< The file descriptor of the group leader
+	std::shared_ptr<Record>											m_pRecord;		///< The statistics of the thread
+};
+
+// ================================ Performance Scope Class ================================
+/**
+ * @brief Profiled scope class
+ * @details Measures the events and the wall time between its construction and its destruction and adds them to the statistics of
+ * the calling thread. Use the PERF_SCOPE() macro, which compiles to nothing in the non-profiling builds
+ */
+class CPerfScope
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param stage The render stage, the scope belongs to
+	 */
+	CPerfScope(PerfStage stage)
+		: m_stage(stage)
+		, m_counters(CPerfCounters::get())
+	{
+		m_counters.read(m_start);
+		m_ticks = getTickCount();
+	}
+	CPerfScope(const CPerfScope&) = delete;
+	~CPerfScope(void)
+	{
+		CPerfCounters::Counts counts;
+		counts.time = 1000.0 * (getTickCount() - m_ticks) / getTickFrequency();
+		m_counters.read(counts.events);
+		for (size_t e = 0; e < CPerfCounters::nEvents; e++)
+			counts.events[e] = counts.events[e] > m_start[e] ? counts.events[e] - m_start[e] : 0;
+		counts.calls = 1;
+		m_counters.add(m_stage, counts);
+	}
+	const CPerfScope& operator=(const CPerfScope&) = delete;
+
+
+private:
+	PerfStage											m_stage;		///< The stage of the scope
+	CPerfCounters&										m_counters;		///< The counters of the calling thread
+	std::array<qword, CPerfCounters::nEvents>			m_start;		///< The counts at the beginning of the scope
+	int64												m_ticks;		///< The time at the beginning of the scope
+};
+
+#ifdef ENABLE_PERF_COUNTERS
+/// Profiles the rest of the enclosing block as stage \b stage (Ref. CPerfScope)
+#define PERF_SCOPE(stage) CPerfScope perfScope(stage)
+#else
+#define PERF_SCOPE(stage)
+#endif
@@ -0,0 +1,90 @@
+// Triangle Mesh Geometrical Primitive class
+#pragma once
+
+#include "PrimTriangle.h"
+#include "ray.h"
+#ifdef ENABLE_BSP
+#include "BSPTree.h"
+#endif
+
+// ================================ Triangle Mesh Primitive Class ================================
+/**
+ * @brief Triangle mesh Geometrical Primitive class
+ * @details The mesh is added to the scene as one primitive, which keeps its triangles in its own acceleration structure.
+ * Thus the scene tree holds a single reference to the mesh, and the triangles are traversed only by the rays, which enter its bounding box.
+ * The rays hit the triangles: Ray::hit points to the hit triangle, which provides the normal and the shader
+ */
+class CPrimMesh final : public IPrim
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @details Creates the triangles and builds the BSP tree over them with the parameters, derived from the mesh (Ref. CBSPTree::build())
+	 * @param pShader Pointer to the shader to be applied for the triangles
+	 * @param vVertexes The vertex positions
+	 * @param vFaces The triangles as triples of the vertex indices
+	 */
+	CPrimMesh(ptr_shader_t pShader, const std::vector<Vec3f>& vVertexes, const std::vector<Vec3i>& vFaces)
+		: IPrim(pShader)
+	{
+		m_vpPrims.reserve(vFaces.size());
+		for (const Vec3i& face : vFaces) {
+			m_vpPrims.push_back(std::make_shared<CPrimTriangle>(pShader, vVertexes[face.val[0]], vVertexes[face.val[1]], vVertexes[face.val[2]]));
+			m_box.extend(m_vpPrims.back()->getBoundingBox());
+		}
+#ifdef ENABLE_BSP
+		m_tree.build(m_vpPrims, 0, 0);
+#endif
+	}
+	virtual ~CPrimMesh(void) = default;
+
+	virtual bool intersect(Ray& ray) const override
+	{
+#ifdef ENABLE_BSP
+		return m_tree.intersect(ray);
+#else
+		float t0 = 0;
+		float t1 = ray.t;
+		m_box.clip(ray, t0, t1);
+		if (t1 < t0) return false;
+		bool hit = false;
+		for (const auto& pPrim : m_vpPrims)
+			hit |= pPrim->intersect(ray);
+		return hit;
+#endif
+	}
+
+	virtual Vec3f getNormal(const Ray& ray) const override
+	{
+		// the hit primitive is the triangle of the mesh
+		return ray.hit->getNormal(ray);
+	}
+
+	virtual CBoundingBox getBoundingBox(void) const override { return m_box; }
+
+	/**
+	 * @brief Returns the number of triangles
+	 * @returns The number of triangles of the mesh
+	 */
+	size_t getNumTriangles(void) const { return m_vpPrims.size(); }
+	/**
+	 * @brief Returns the memory occupied by the mesh
+	 * @returns The size of the triangles and of the acceleration structure in bytes
+	 */
+	size_t getMemoryUsage(void) const
+	{
+		size_t res = m_vpPrims.size() * (sizeof(ptr_prim_t) + sizeof(CPrimTriangle));
+#ifdef ENABLE_BSP
+		res += m_tree.getMemoryUsage();
+#endif
+		return res;
+	}
+
+
+private:
+	std::vector<ptr_prim_t>	m_vpPrims;	///< The triangles
+	CBoundingBox			m_box;		///< The bounding box of the triangles
+#ifdef ENABLE_BSP
+	CBSPTree				m_tree;		///< The acceleration structure over the triangles
+#endif
+};
@@ -8,7 +8,7 @@
 /**
  * @brief The Plane Geometrical Primitive class
  */
-class CPrimPlane : public IPrim
+class CPrimPlane final : public IPrim
 {
 public:
 	/**
@@ -18,18 +18,18 @@ public:
 	 * @param normal Normal to the plane
 	 */
 	CPrimPlane(ptr_shader_t pShader, Vec3f origin, Vec3f normal)
-		: IPrim(pShader)
+		: IPrim(pShader, PrimType::plane)
 		, m_normal(normal)
 		, m_origin(origin)
 	{
-		normalize(m_normal);
+		m_normal = normalize(m_normal);
 	}
 	virtual ~CPrimPlane(void) = default;
 
 	virtual bool intersect(Ray& ray) const override
 	{
 		float dist = (m_origin - ray.org).dot(m_normal) / ray.dir.dot(m_normal);
-		if (dist < Epsilon || isinf(dist) || dist > ray.t) return false;
+		if (dist <= 0 || isinf(dist) || dist > ray.t) return false;
 
 		ray.t = dist;
 		ray.hit = shared_from_this();
@@ -43,12 +43,15 @@ public:
 
 	virtual CBoundingBox getBoundingBox(void) const override
 	{
-		CBoundingBox bounds;
-		// --- PUT YOUR CODE HERE ---
-		return bounds;
+		// The plane is infinite: only the planes orthogonal to an axis have finite extent in that axis
+		Vec3f minPoint = Vec3f::all(-Infty);
+		Vec3f maxPoint = Vec3f::all(Infty);
+		for (int i = 0; i < 3; i++)
+			if (fabs(m_normal.val[i]) == 1) minPoint.val[i] = maxPoint.val[i] = m_origin.val[i];
+		return CBoundingBox(minPoint, maxPoint);
 	}
 
 private:
-	Vec3f m_normal;	///< Point on the plane
-	Vec3f m_origin;	///< Normal to the plane
+	Vec3fa m_normal;	///< Point on the plane
+	Vec3fa m_origin;	///< Normal to the plane
 };
@@ -8,7 +8,7 @@
 /**
  * @brief Sphere Geaometrical Primitive class
  */
-class CPrimSphere : public IPrim
+class CPrimSphere final : public IPrim
 {
 public:
 	/**
@@ -18,7 +18,7 @@ public:
 	 * @param radius Radius of the sphere
 	 */
 	CPrimSphere(ptr_shader_t pShader, Vec3f origin, float radius)
-		: IPrim(pShader)
+		: IPrim(pShader, PrimType::sphere)
 		, m_origin(origin)
 		, m_radius(radius)
 	{}
@@ -26,28 +26,36 @@ public:
 
 	virtual bool intersect(Ray& ray) const override
 	{
-		// mathematical derivation, numerically not very stable, but simple
-
 		// --> find roots of f(t) = ((R+tD)-C)^2 - r^2
 		// f(t) = (R-C)^2 + 2(R-C)(tD) + (tD)^2 -r^2
 		// --> f(t) = [D^2] t^2 + [2D(R-C)] t + [(R-C)^2 - r^2]
-		Vec3f diff = ray.org - m_origin;
+		const Vec3fa diff = ray.org - m_origin;
 		float a = ray.dir.dot(ray.dir);
 		float b = 2 * ray.dir.dot(diff);
 		float c = diff.dot(diff) - m_radius * m_radius;
 
 		// use 'abc'-formula for finding root t_1,2 = (-b +/- sqrt(b^2-4ac))/(2a)
-		float inRoot = b * b - 4 * a * c;
+		// b^2-4ac = 4a(r^2 - l^2), where l is the distance from the center to the ray line. It is calculated in this form,
+		// since the difference b^2-4ac of two large numbers would lose the precision for the distant ray origins
+		const Vec3fa l = diff - (0.5f * b / a) * ray.dir;
+		float inRoot = 4 * a * (m_radius * m_radius - l.dot(l));
 		if (inRoot < 0) return false;
 		float root = sqrtf(inRoot);
 
-		float dist = (-b - root) / (2 * a);
+		// the root, where -b and the square root have the same sign, is calculated directly and the other one from Vieta's formula
+		// thus no cancellation occurs, and the root close to zero (at the origin of a ray, spawned from the sphere) stays accurate
+		float q = -0.5f * (b < 0 ? b - root : b + root);
+		float t0 = q / a;
+		float t1 = c / q;
+		if (t0 > t1) std::swap(t0, t1);
+
+		float dist = t0;
 		if (dist > ray.t)
 			return false;
 
-		if (dist < Epsilon) {
-			dist = (-b + root) / (2 * a);
-			if (dist < Epsilon || dist > ray.t)
+		if (dist <= 0) {
+			dist = t1;
+			if (dist <= 0 || dist > ray.t)
 				return false;
 		}
 
@@ -58,21 +66,17 @@ public:
 
 	virtual Vec3f getNormal(const Ray& ray) const override
 	{
-		Vec3f hit = ray.org + ray.t * ray.dir;
-		Vec3f normal = hit - m_origin;
-		normal = normalize(normal);
-		return normal;
+		Vec3fa hit = ray.org + ray.t * ray.dir;
+		return normalize(hit - m_origin);
 	}
 
 	virtual CBoundingBox getBoundingBox(void) const override
 	{
-		CBoundingBox res;
-		// --- PUT YOUR CODE HERE ---
-		return res;
+		return CBoundingBox(m_origin - Vec3fa::all(m_radius), m_origin + Vec3fa::all(m_radius));
 	}
 
 
 private:
-	Vec3f m_origin;	///< Position of the center of the sphere
+	Vec3fa m_origin;	///< Position of the center of the sphere
 	float m_radius;	///< Radius of the sphere
 };
@@ -8,7 +8,7 @@
 /**
  * @brief Triangle Geometrical Primitive class
  */
-class CPrimTriangle : public IPrim
+class CPrimTriangle final : public IPrim
 {
 public:
 	/**
@@ -19,7 +19,7 @@ public:
 	 * @param c Position of the third vertex
 	 */
 	CPrimTriangle(ptr_shader_t pShader, const Vec3f& a, const Vec3f& b, const Vec3f& c)
-		: IPrim(pShader)
+		: IPrim(pShader, PrimType::triangle)
 		, m_a(a)
 		, m_b(b)
 		, m_c(c)
@@ -30,31 +30,28 @@ public:
 
 	virtual bool intersect(Ray& ray) const override
 	{
-		const Vec3f edge1 = m_b - m_a;
-		const Vec3f edge2 = m_c - m_a;
+		const Vec3fa pvec = ray.dir.cross(m_edge2);
 
-		const Vec3f pvec = ray.dir.cross(edge2);
-
-		const float det = edge1.dot(pvec);
+		const float det = m_edge1.dot(pvec);
 		if (fabs(det) < Epsilon) return false;
 
 		const float inv_det = 1.0f / det;
 
-		const Vec3f tvec = ray.org - m_a;
+		const Vec3fa tvec = ray.org - m_a;
 		float lambda = tvec.dot(pvec);
 		lambda *= inv_det;
 
 		if (lambda < 0.0f || lambda > 1.0f) return false;
 
-		const Vec3f qvec = tvec.cross(edge1);
+		const Vec3fa qvec = tvec.cross(m_edge1);
 		float mue = ray.dir.dot(qvec);
 		mue *= inv_det;
 
 		if (mue < 0.0f || mue + lambda > 1.0f) return false;
 
-		float f = edge2.dot(qvec);
+		float f = m_edge2.dot(qvec);
 		f *= inv_det;
-		if (ray.t <= f || f < Epsilon) return false;
+		if (ray.t <= f || f <= 0) return false;
 
 		ray.t = f;
 		ray.hit = shared_from_this();
@@ -69,15 +66,50 @@ public:
 	virtual CBoundingBox getBoundingBox(void) const override
 	{
 		CBoundingBox res;
-		// --- PUT YOUR CODE HERE ---
+		res.extend(m_a);
+		res.extend(m_b);
+		res.extend(m_c);
+		return res;
+	}
+
+	virtual CBoundingBox getClippedBoundingBox(const CBoundingBox& box) const override
+	{
+		// Sutherland-Hodgman clipping of the triangle by the 6 planes of the box; every plane adds at most one vertex
+		std::array<Vec3fa, 9> polygon = { m_a, m_b, m_c };
+		std::array<Vec3fa, 9> clipped;
+		size_t n = 3;
+		for (int i = 0; i < 6 && n > 0; i++) {
+			const int dim = i / 2;
+			const float sign = (i % 2) ? -1.0f : 1.0f;	// the inside is sign * (p - bound) >= 0
+			const float bound = (i % 2) ? box.getMaxPoint().val[dim] : box.getMinPoint().val[dim];
+			size_t m = 0;
+			for (size_t j = 0; j < n; j++) {
+				const Vec3fa& p = polygon[j];
+				const Vec3fa& q = polygon[(j + 1) % n];
+				float dp = sign * (p.val[dim] - bound);
+				float dq = sign * (q.val[dim] - bound);
+				if (dp >= 0) clipped[m++] = p;
+				if ((dp < 0 && dq > 0) || (dp > 0 && dq < 0)) {
+					Vec3fa x = p + (q - p) * (dp / (dp - dq));
+					x.val[dim] = bound;
+					clipped[m++] = x;
+				}
+			}
+			std::swap(polygon, clipped);
+			n = m;
+		}
+
+		CBoundingBox res;
+		for (size_t j = 0; j < n; j++) res.extend(polygon[j]);
+		res.intersect(box);
 		return res;
 	}
 
 
 private:
-	Vec3f m_a;		///< Position of the first vertex
-	Vec3f m_b;		///< Position of the second vertex
-	Vec3f m_c;		///< Position of the third vertex
-	Vec3f m_edge1;	///< Edge AB
-	Vec3f m_edge2;	///< Edge AC
+	Vec3fa m_a;		///< Position of the first vertex
+	Vec3fa m_b;		///< Position of the second vertex
+	Vec3fa m_c;		///< Position of the third vertex
+	Vec3fa m_edge1;	///< Edge AB
+	Vec3fa m_edge2;	///< Edge AC
 };
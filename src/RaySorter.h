@@ -0,0 +1,77 @@
+// Ray Sorter class
+#pragma once
+
+#include "ray.h"
+
+// ================================ Ray Sorter Class ================================
+/**
+ * @brief Ray sorter class
+ * @details Reorders a batch of incoherent rays, such that the rays, which start close to each other and point in the same direction octant,
+ * are traced one after another. Such rays visit mostly the same BSP nodes and primitives, which are then still in the cache.
+ * The sort key of a ray is the Morton code (Z-order curve) of its origin, quantized to a 2<sup>20</sup> grid over the bounds of
+ * the batch origins, followed by the 3 sign bits of its direction.
+ * @note The sorter keeps its buffers between the batches, thus it should be kept per thread (Ref. CRenderContext::getScratch())
+ */
+class CRaySorter
+{
+public:
+	CRaySorter(void) = default;
+	CRaySorter(const CRaySorter&) = delete;
+	~CRaySorter(void) = default;
+	const CRaySorter& operator=(const CRaySorter&) = delete;
+
+	/**
+	 * @brief Sorts a batch of rays
+	 * @tparam T The type of the batch items
+	 * @tparam F The type of the accessor: <code>const Ray& F(const T&)</code>
+	 * @param vItems The batch
+	 * @param getRay The accessor, which returns the ray of a batch item
+	 * @returns The indices of the batch items in the order, in which they should be traced
+	 */
+	template <class T, class F>
+	const std::vector<dword>& sort(const std::vector<T>& vItems, F getRay)
+	{
+		CBoundingBox box;
+		for (const T& item : vItems) box.extend(getRay(item).org);
+		const Vec3f minPoint = box.getMinPoint();
+		const Vec3f extent = box.getMaxPoint() - minPoint;
+
+		m_vKeys.resize(vItems.size());
+		for (size_t i = 0; i < vItems.size(); i++) {
+			const Ray& ray = getRay(vItems[i]);
+			qword key = 0;
+			for (int d = 0; d < 3; d++) {
+				float u = extent.val[d] > 0 ? (ray.org.val[d] - minPoint.val[d]) / extent.val[d] : 0;
+				dword cell = static_cast<dword>(MIN(MAX(u, 0.0f), 1.0f) * m_gridMask);
+				key |= expandBits(cell) << (3 + 2 - d);
+				key |= static_cast<qword>(ray.dir.val[d] < 0) << d;
+			}
+			m_vKeys[i] = std::make_pair(key, static_cast<dword>(i));
+		}
+		std::sort(m_vKeys.begin(), m_vKeys.end());
+
+		m_vOrder.resize(m_vKeys.size());
+		for (size_t i = 0; i < m_vKeys.size(); i++) m_vOrder[i] = m_vKeys[i].second;
+		return m_vOrder;
+	}
+
+
+private:
+	// Inserts two zero bits before each of the 20 lower bits of v
+	static qword expandBits(dword v)
+	{
+		qword x = v & m_gridMask;
+		x = (x | (x << 32)) & 0x001F00000000FFFFULL;
+		x = (x | (x << 16)) & 0x001F0000FF0000FFULL;
+		x = (x | (x << 8))  & 0x100F00F00F00F00FULL;
+		x = (x | (x << 4))  & 0x10C30C30C30C30C3ULL;
+		x = (x | (x << 2))  & 0x1249249249249249ULL;
+		return x;
+	}
+
+
+private:
+	static constexpr dword					m_gridMask = (1 << 20) - 1;		///< The largest grid coordinate
+	std::vector<std::pair<qword, dword>>	m_vKeys;						///< The sort keys with the indices of the batch items
+	std::vector<dword>						m_vOrder;						///< The sorted indices of the batch items
+};
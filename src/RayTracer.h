@@ -0,0 +1,114 @@
+// Secondary Ray Tracer class
+#pragma once
+
+#include "ShaderDispatch.h"
+#include "RenderContext.h"
+
+// ================================ Ray Tracer Class ================================
+/**
+ * @brief Secondary ray tracer class
+ * @details Follows the reflection and refraction bounces (Ref. IShader::scatter()) iteratively. The pending rays are kept on a
+ * fixed-size per-thread stack, thus tracing neither recurses nor allocates memory. Since every hit replaces one ray on the stack by
+ * at most two, depth-first processing never keeps more than <code>maxDepth + 1</code> rays on the stack.
+ * A branch is terminated, when its depth reaches the maximal one, or when its throughput (the product of the weights along the branch)
+ * falls below the threshold. After a few bounces the branches are also terminated randomly with the probability, growing as
+ * the throughput decreases (Russian roulette); the surviving branches are re-weighted, which keeps the estimate unbiased.
+ */
+class CRayTracer
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param scene Reference to the scene
+	 * @param maxDepth The maximal number of bounces. It is limited by the size of the stack (Ref. maxStackSize)
+	 * @param minThroughput The throughput, below which the branches are skipped
+	 * @param rouletteDepth The number of bounces, after which the Russian roulette starts
+	 */
+	CRayTracer(CScene& scene, size_t maxDepth = 8, float minThroughput = 1.0f / 256, size_t rouletteDepth = 3)
+		: m_scene(scene)
+		, m_maxDepth(MIN(maxDepth, maxStackSize - 1))
+		, m_minThroughput(minThroughput)
+		, m_rouletteDepth(rouletteDepth)
+	{}
+	CRayTracer(const CRayTracer&) = delete;
+	~CRayTracer(void) = default;
+	const CRayTracer& operator=(const CRayTracer&) = delete;
+
+	/**
+	 * @brief Calculates the color of the hit by the primary ray \b ray, including the reflected and refracted light
+	 * @details The random numbers are drawn from the current sample of the rendering context (Ref. CRenderContext::setSample())
+	 * @param ray The primary ray. ray.hit must point to the primitive
+	 * @return The color of the hit object
+	 */
+	Vec3f shade(const Ray& ray) const { return ShaderDispatch::shade(ray) + traceSecondary(ray); }
+	/**
+	 * @brief Calculates the light, reflected and refracted at the hit of the ray \b ray, i.e. the color without the direct shading of the hit
+	 * @details This method is used by the renderers, which shade the primary hits themselves (e.g. in batches); for the shaders, which do not
+	 * scatter (Ref. IShader::scatter()), it returns zero at the cost of one call to IShader::scatter(). The random numbers are drawn from the
+	 * current sample of the rendering context
+	 * @param ray The primary ray. ray.hit must point to the primitive
+	 * @return The color, seen along the secondary rays of the hit
+	 */
+	Vec3f traceSecondary(const Ray& ray) const
+	{
+		Vec3f res = Vec3f::all(0);
+		if (m_maxDepth == 0) return res;
+
+		CRenderContext& context = CRenderContext::get();
+		Stack& stack = context.getScratch<Stack>();
+		std::array<SecondaryRay, 2> secondary;
+		size_t top = push(ray, Vec3f::all(1), 0, stack, 0, secondary, context.getRNG());
+
+		while (top > 0) {
+			Entry entry = std::move(stack[--top]);		// the slot is reused by the secondary rays
+			if (!m_scene.intersect(entry.ray)) {
+				res += entry.throughput.mul(m_scene.getBackgroundColor());
+				continue;
+			}
+			res += entry.throughput.mul(ShaderDispatch::shade(entry.ray));
+			top = push(entry.ray, entry.throughput, entry.depth, stack, top, secondary, context.getRNG());
+		}
+		return res;
+	}
+
+
+public:
+	static constexpr size_t maxStackSize = 32;		///< The size of the ray stack
+
+
+private:
+	/// Pending ray
+	struct Entry
+	{
+		Ray			ray;			///< The ray to be traced
+		Vec3f		throughput;		///< The factor, the color seen along the ray is to be multiplied with
+		size_t		depth;			///< The number of bounces before the ray
+	};
+	using Stack = std::array<Entry, maxStackSize>;
+
+	// Pushes the surviving secondary rays of the hit of ray onto the stack and returns the new top of the stack
+	size_t push(const Ray& ray, const Vec3f& throughput, size_t depth, Stack& stack, size_t top, std::array<SecondaryRay, 2>& secondary, CRandom& rng) const
+	{
+		if (depth >= m_maxDepth) return top;
+		size_t n = ShaderDispatch::scatter(ray, secondary);
+		for (size_t i = 0; i < n; i++) {
+			Vec3f t = throughput.mul(secondary[i].weight);
+			float maxT = MAX(t.val[0], MAX(t.val[1], t.val[2]));
+			if (maxT < m_minThroughput) continue;
+			if (depth + 1 > m_rouletteDepth) {
+				float survival = MIN(maxT, 1.0f);
+				if (rng.uniform() >= survival) continue;
+				t = t * (1.0f / survival);
+			}
+			stack[top++] = Entry{ secondary[i].ray, t, depth + 1 };
+		}
+		return top;
+	}
+
+
+private:
+	CScene&		m_scene;				///< The scene
+	size_t		m_maxDepth;				///< The maximal number of bounces
+	float		m_minThroughput;		///< The throughput, below which the branches are skipped
+	size_t		m_rouletteDepth;		///< The number of bounces, after which the Russian roulette starts
+};
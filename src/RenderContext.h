@@ -0,0 +1,121 @@
+// Rendering context class
+#pragma once
+
+#include "types.h"
+#include <typeindex>
+#include <unordered_map>
+
+// ================================ Random Number Generator Class ================================
+/**
+ * @brief Counter-based random number generator
+ * @details The n-th number of the sequence is a hash of the stream key and the counter n. Thus the sequence depends only on the key
+ * and not on the order in which the streams are used, which makes the rendering reproducible regardless of the scheduling of the work
+ */
+class CRandom
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param key The key of the stream
+	 */
+	CRandom(qword key = 0) : m_key(mix(key)) {}
+	~CRandom(void) = default;
+
+	/**
+	 * @brief Returns the next random number of the stream
+	 * @returns A uniformly distributed 32-bit random number
+	 */
+	dword next(void) { return static_cast<dword>(mix(m_key + 0x9E3779B97F4A7C15ULL * ++m_counter) >> 32); }
+	/**
+	 * @brief Returns the next random number of the stream
+	 * @returns A uniformly distributed random number in range [0; 1)
+	 */
+	float uniform(void) { return (next() >> 8) * (1.0f / (1 << 24)); }
+	/**
+	 * @brief Mixes the bits of the argument (SplitMix64 finalizer)
+	 * @param x The value to be hashed
+	 * @returns The hash value
+	 */
+	static qword mix(qword x)
+	{
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+
+
+private:
+	qword m_key;			///< The hashed key of the stream
+	qword m_counter = 0;	///< The number of generated numbers
+};
+
+// ================================ Render Context Class ================================
+/**
+ * @brief Rendering context class
+ * @details Every rendering thread owns its own context (Ref. get()), which holds the per-thread scratch memory and
+ * the random number stream of the currently rendered sample. The stream is keyed by the pixel and sample indices (Ref. setSample()),
+ * thus the result of sampling does not depend on the thread, which renders the pixel, nor on the order of the pixels.
+ */
+class CRenderContext
+{
+public:
+	CRenderContext(const CRenderContext&) = delete;
+	~CRenderContext(void) = default;
+	const CRenderContext& operator=(const CRenderContext&) = delete;
+
+	/**
+	 * @brief Returns the rendering context of the calling thread
+	 * @returns The reference to the rendering context of the calling thread
+	 */
+	static CRenderContext& get(void)
+	{
+		static thread_local CRenderContext context;
+		return context;
+	}
+	/**
+	 * @brief Sets the global seed, which is mixed into the keys of all the random number streams
+	 * @param seed The seed
+	 */
+	static void setSeed(qword seed) { m_seed = seed; }
+
+	/**
+	 * @brief Starts a new sample and resets the random number stream
+	 * @param x The x-coordinate of the pixel
+	 * @param y The y-coordinate of the pixel
+	 * @param sample The index of the sample within the pixel
+	 */
+	void setSample(int x, int y, int sample = 0)
+	{
+		qword key = CRandom::mix(m_seed ^ static_cast<dword>(x));
+		key = CRandom::mix(key ^ static_cast<dword>(y));
+		m_rng = CRandom(key ^ static_cast<dword>(sample));
+	}
+	/**
+	 * @brief Returns the random number stream of the current sample
+	 * @returns The reference to the random number generator
+	 */
+	CRandom& getRNG(void) { return m_rng; }
+	/**
+	 * @brief Returns the per-thread scratch object of type \b T
+	 * @details The object is created on the first call and is reused by the subsequent calls from the same thread
+	 * @tparam T The type of the scratch object. It must be default-constructible
+	 * @returns The reference to the scratch object
+	 */
+	template <class T>
+	T& getScratch(void)
+	{
+		auto& pScratch = m_scratch[std::type_index(typeid(T))];
+		if (!pScratch) pScratch = std::make_shared<T>();
+		return *std::static_pointer_cast<T>(pScratch);
+	}
+
+
+private:
+	CRenderContext(void) = default;
+
+
+private:
+	static inline qword											m_seed = 0;		///< The global seed
+	CRandom														m_rng;			///< The random number stream of the current sample
+	std::unordered_map<std::type_index, std::shared_ptr<void>>	m_scratch;		///< The scratch objects
+};
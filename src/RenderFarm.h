@@ -0,0 +1,326 @@
+// Distributed Render Farm class
+#pragma once
+
+#include "RendererImmediate.h"
+#include <deque>
+#include <functional>
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// ================================ Render Farm Class ================================
+/**
+ * @brief Distributed render farm class
+ * @details The coordinator (Ref. render()) splits the image into tile jobs and serves them over TCP sockets to the worker processes
+ * (Ref. work()), which may run on the same or on other machines. Every worker builds the scene and its acceleration structure once
+ * and then renders the jobs one after another. The workers pull new jobs as soon as they return the results, so the faster workers
+ * get more work. If a worker dies or hangs, i.e. does not return its next result within the job timeout, it is dropped and its unfinished jobs
+ * are re-queued; if no workers are left, the coordinator renders the rest itself.
+ * @note The pixels are transferred as raw 32-bit floats, thus all the machines must share the same byte order
+ * @note The render farm is not available on Windows
+ */
+class CRenderFarm
+{
+public:
+	/// Function, which populates the scene (geometry, lights, camera and acceleration structures)
+	using scene_factory_t = std::function<void(CScene&)>;
+
+	/**
+	 * @brief Constructor
+	 * @param sceneFactory The function, which populates the scene. It is called once by every worker process
+	 * @param jobSize The size of the tile jobs in pixels
+	 * @param jobTimeout The time in seconds, within which a worker must return its next result; otherwise the worker is dropped
+	 */
+	CRenderFarm(scene_factory_t sceneFactory, Size jobSize = Size(64, 64), double jobTimeout = 30)
+		: m_sceneFactory(sceneFactory)
+		, m_jobSize(jobSize)
+		, m_jobTimeout(jobTimeout)
+	{}
+	CRenderFarm(const CRenderFarm&) = delete;
+	~CRenderFarm(void) = default;
+	const CRenderFarm& operator=(const CRenderFarm&) = delete;
+
+	/**
+	 * @brief Renders the frame as the coordinator
+	 * @details This function forks \b nLocalWorkers worker processes on this machine and accepts connections of the remote workers on port \b port
+	 * @param resolution The image resolution (must agree with the camera, created by the scene factory)
+	 * @param nLocalWorkers The number of worker processes to be started on this machine
+	 * @param port The TCP port to listen on. If zero, an ephemeral port is used
+	 * @return The rendered image of type CV_32FC3
+	 */
+	Mat render(Size resolution, int nLocalWorkers, int port = 0)
+	{
+		Mat img(resolution, CV_32FC3);
+		std::deque<Rect> qJobs;
+		for (int y = 0; y < resolution.height; y += m_jobSize.height)
+			for (int x = 0; x < resolution.width; x += m_jobSize.width)
+				qJobs.push_back(Rect(x, y, MIN(m_jobSize.width, resolution.width - x), MIN(m_jobSize.height, resolution.height - y)));
+		size_t nJobsLeft = qJobs.size();
+
+#ifndef _WIN32
+		int listener = socket(AF_INET, SOCK_STREAM, 0);
+		int one = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(static_cast<uint16_t>(port));
+		socklen_t addrLen = sizeof(addr);
+		if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listener, 64) < 0
+			|| getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &addrLen) < 0) {
+			printf("ERROR: Can't listen on port %d\n", port);
+			if (listener >= 0) close(listener);
+			nLocalWorkers = 0;
+			listener = -1;
+		} else
+			printf("Render farm coordinator is listening on port %d\n", ntohs(addr.sin_port));
+
+		// Start the local workers
+		std::vector<pid_t> vChildren;
+		fflush(stdout);
+		for (int i = 0; i < nLocalWorkers; i++) {
+			pid_t pid = fork();
+			if (pid == 0) {
+				close(listener);
+				work(m_sceneFactory, "127.0.0.1", ntohs(addr.sin_port));
+				_exit(0);
+			}
+			if (pid > 0) vChildren.push_back(pid);
+		}
+
+		// Serve the jobs
+		std::vector<Worker> vWorkers;
+		int64 idleSince = getTickCount();
+		while (nJobsLeft > 0 && listener >= 0) {
+			std::vector<pollfd> vFds(1, pollfd{ listener, POLLIN, 0 });
+			for (const auto& worker : vWorkers) vFds.push_back(pollfd{ worker.socket, POLLIN, 0 });
+			int nEvents = poll(vFds.data(), vFds.size(), 1000);
+
+			if (nEvents > 0 && (vFds[0].revents & POLLIN)) {
+				int s = accept(listener, nullptr, nullptr);
+				if (s >= 0) {
+					setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+					// the tile payload follows its header at once, thus a worker stalling within a message does not block the others for long
+					timeval timeout{ static_cast<time_t>(m_recvTimeout), 0 };
+					setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+					setKeepAlive(s);
+					vWorkers.push_back(Worker{ s, {}, 0 });
+					for (size_t j = 0; j < m_nJobsInFlight; j++) assignJob(vWorkers.back(), qJobs);
+				}
+			}
+
+			const int64 now = getTickCount();
+			for (size_t i = 1; i < vFds.size(); i++) {
+				Worker& worker = vWorkers[i - 1];
+				if (!vFds[i].revents) {
+					if (worker.vJobs.empty() || now < worker.deadline) continue;
+					// the worker hangs, e.g. its machine is off or the network is cut, thus its socket is never closed
+					printf("Warning: Dropping a worker, which did not return a job within %.0f s\n", m_jobTimeout);
+				}
+				bool alive = false;
+				MessageHeader header;
+				if (vFds[i].revents && recvAll(worker.socket, &header, sizeof(header)) && header.type == MessageType::result) {
+					// the result must be one of the jobs, assigned to the worker; otherwise the worker is dropped as faulty
+					auto it = std::find(worker.vJobs.begin(), worker.vJobs.end(), header.rect);
+					if (it != worker.vJobs.end() && isInside(*it, resolution)) {
+						const Rect job = *it;
+						Mat tile(job.size(), CV_32FC3);
+						if (recvAll(worker.socket, tile.data, tile.total() * tile.elemSize())) {
+							alive = true;
+							worker.vJobs.erase(it);
+							worker.deadline = getTickCount() + static_cast<int64>(m_jobTimeout * getTickFrequency());
+							tile.copyTo(img(job));
+							nJobsLeft--;
+							assignJob(worker, qJobs);
+						} else
+							printf("Warning: Dropping a worker, which did not send a complete result\n");
+					} else
+						printf("Warning: Dropping a worker, which returned an unknown job [%d, %d, %d x %d]\n", header.rect.x, header.rect.y, header.rect.width, header.rect.height);
+				}
+				if (!alive) {
+					// the worker has died or is faulty: re-queue its jobs
+					for (const Rect& job : worker.vJobs) qJobs.push_front(job);
+					close(worker.socket);
+					worker.socket = -1;
+					for (auto& w : vWorkers) while (w.socket >= 0 && w.vJobs.size() < m_nJobsInFlight && !qJobs.empty()) assignJob(w, qJobs);
+				}
+			}
+			// Give up on the workers, if there are none for a while and all the local ones are gone
+			if (!vWorkers.empty()) idleSince = getTickCount();
+			vWorkers.erase(std::remove_if(vWorkers.begin(), vWorkers.end(), [](const Worker& w) { return w.socket < 0; }), vWorkers.end());
+			for (auto it = vChildren.begin(); it != vChildren.end(); )
+				it = (waitpid(*it, nullptr, WNOHANG) == *it) ? vChildren.erase(it) : it + 1;
+			if (vWorkers.empty() && vChildren.empty() && (getTickCount() - idleSince) / getTickFrequency() > m_idleTimeout) break;
+		}
+
+		// Stop the workers
+		for (const auto& worker : vWorkers) {
+			MessageHeader header{ MessageType::quit, {} };
+			sendAll(worker.socket, &header, sizeof(header));
+			close(worker.socket);
+		}
+		if (listener >= 0) close(listener);
+		for (pid_t pid : vChildren) waitpid(pid, nullptr, 0);
+#else
+		printf("Warning: The render farm is not supported on this platform!\n");
+#endif
+
+		// Render the rest locally
+		if (nJobsLeft > 0) {
+			printf("Rendering the remaining %zu job(s) locally\n", nJobsLeft);
+			CScene scene;
+			m_sceneFactory(scene);
+			CRendererImmediate renderer(scene);
+			for (const Rect& job : qJobs)
+				if (isInside(job, resolution)) renderer.render(job, img);
+		}
+		return img;
+	}
+
+	/**
+	 * @brief Runs the worker
+	 * @details The worker connects to the coordinator, builds the scene and renders the jobs until the coordinator quits or disconnects
+	 * @param sceneFactory The function, which populates the scene
+	 * @param host The host name or address of the coordinator
+	 * @param port The TCP port of the coordinator
+	 */
+	static void work(scene_factory_t sceneFactory, const std::string& host, int port)
+	{
+#ifndef _WIN32
+		addrinfo hints = {};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo* pAddr = nullptr;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &pAddr) != 0 || !pAddr) {
+			printf("ERROR: Can't resolve the coordinator address %s\n", host.c_str());
+			return;
+		}
+		int s = socket(pAddr->ai_family, pAddr->ai_socktype, pAddr->ai_protocol);
+		bool connected = s >= 0 && connect(s, pAddr->ai_addr, pAddr->ai_addrlen) == 0;
+		freeaddrinfo(pAddr);
+		if (!connected) {
+			printf("ERROR: Can't connect to the coordinator %s:%d\n", host.c_str(), port);
+			if (s >= 0) close(s);
+			return;
+		}
+		int one = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		setKeepAlive(s);
+
+		// The scene and its acceleration structure are kept for all the jobs
+		CScene scene;
+		sceneFactory(scene);
+		CRendererImmediate renderer(scene);
+		Mat img(scene.getActiveCamera()->getResolution(), CV_32FC3);
+
+		MessageHeader header;
+		while (recvAll(s, &header, sizeof(header)) && header.type == MessageType::job) {
+			const Rect& job = header.rect;
+			if (!isInside(job, img.size())) {
+				printf("ERROR: The job [%d, %d, %d x %d] is outside of the image\n", job.x, job.y, job.width, job.height);
+				break;
+			}
+			renderer.render(job, img);
+			Mat tile = img(job).clone();
+			header.type = MessageType::result;
+			if (!sendAll(s, &header, sizeof(header)) || !sendAll(s, tile.data, tile.total() * tile.elemSize())) break;
+		}
+		close(s);
+#else
+		printf("Warning: The render farm is not supported on this platform!\n");
+#endif
+	}
+
+
+private:
+	enum class MessageType : int32_t { job, result, quit };
+
+	/// Message header. The result message is followed by the tile pixels
+	struct MessageHeader
+	{
+		MessageType	type;
+		Rect		rect;		///< The image region of the job
+	};
+
+	/// Connected worker
+	struct Worker
+	{
+		int					socket;		///< The socket of the connection
+		std::vector<Rect>	vJobs;		///< The jobs, assigned to the worker and not yet returned
+		int64				deadline;	///< The time in ticks, by which the worker must return its next result (if it has jobs)
+	};
+
+	// Checks whether the job is a non-empty region inside the image of the given resolution
+	static bool isInside(const Rect& job, Size resolution)
+	{
+		return job.x >= 0 && job.y >= 0 && job.width > 0 && job.height > 0 && job.width <= resolution.width - job.x && job.height <= resolution.height - job.y;
+	}
+
+#ifndef _WIN32
+	static bool sendAll(int s, const void* pData, size_t size)
+	{
+		const char* p = static_cast<const char*>(pData);
+		while (size > 0) {
+			ssize_t n = send(s, p, size, MSG_NOSIGNAL);
+			if (n <= 0) return false;
+			p += n;
+			size -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	static bool recvAll(int s, void* pData, size_t size)
+	{
+		char* p = static_cast<char*>(pData);
+		while (size > 0) {
+			ssize_t n = recv(s, p, size, 0);
+			if (n <= 0) return false;
+			p += n;
+			size -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	// Enables the TCP keep-alive probes, thus a connection to a dead machine is detected and closed by the kernel
+	static void setKeepAlive(int s)
+	{
+		int one = 1;
+		setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+#ifdef TCP_KEEPIDLE
+		int idle = 10, interval = 5, count = 3;
+		setsockopt(s, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+		setsockopt(s, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+		setsockopt(s, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+	}
+
+	void assignJob(Worker& worker, std::deque<Rect>& qJobs) const
+	{
+		if (qJobs.empty()) return;
+		MessageHeader header{ MessageType::job, qJobs.front() };
+		qJobs.pop_front();
+		// the deadline runs from the assignment, if the worker was idle, otherwise from its last result
+		if (worker.vJobs.empty()) worker.deadline = getTickCount() + static_cast<int64>(m_jobTimeout * getTickFrequency());
+		worker.vJobs.push_back(header.rect);
+		if (!sendAll(worker.socket, &header, sizeof(header))) {
+			// the failure will be detected by poll()
+		}
+	}
+#endif
+
+
+private:
+	scene_factory_t		m_sceneFactory;				///< The function, which populates the scene
+	Size				m_jobSize;					///< The size of the tile jobs in pixels
+	double				m_jobTimeout;				///< The time in seconds, within which a worker must return its next result
+	const int			m_recvTimeout = 5;			///< The time in seconds, within which a started message must be received completely
+	const size_t		m_nJobsInFlight = 2;		///< The number of jobs sent to a worker in advance
+	const double		m_idleTimeout = 5;			///< The time in seconds to wait for workers, when there are none
+};
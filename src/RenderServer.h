@@ -0,0 +1,369 @@
+// Render Server class
+#pragma once
+
+#include "RendererImmediate.h"
+#include "CameraPerspective.h"
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <thread>
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// ================================ Render Server Class ================================
+/**
+ * @brief Long-running render server class
+ * @details The server keeps the scenes and their acceleration structures resident and renders the requests, received over
+ * a local (Unix domain) socket (Ref. request()). A scene is built by its factory on the first request, which names it, and is
+ * reused by all the following requests. Every request brings its own camera, thus the requests for the same scene may be rendered at once.
+ *
+ * The requests are split into tiles, which are rendered by one shared pool of worker threads. A free worker always takes the next tile
+ * of the request with the highest priority (the oldest one among the equal priorities). Thus a high-priority preview interrupts
+ * a running batch request at the tile boundary, and the batch request continues, when the preview is done.
+ * @note The pixels are transferred as raw 32-bit floats
+ * @note The render server is not available on Windows
+ */
+class CRenderServer
+{
+public:
+	/// Function, which populates the scene (geometry, lights and acceleration structures)
+	using scene_factory_t = std::function<void(CScene&)>;
+
+	/// Render request
+	struct Request
+	{
+		char	scene[64] = {};					///< The name of the scene
+		float	pos[3] = { 0, 0, 0 };			///< The camera origin
+		float	dir[3] = { 0, 0, 1 };			///< The camera viewing direction
+		float	up[3] = { 0, 1, 0 };			///< The camera up-vector
+		float	angle = 60;						///< The vertical opening angle of the camera in degrees
+		int32_t	width = 800;					///< The image width in pixels
+		int32_t	height = 600;					///< The image height in pixels
+		int32_t	samples = 1;					///< The number of samples per pixel. The samples differ by their random number streams
+		int32_t	priority = 0;					///< The priority: the requests with higher priority are rendered first
+	};
+
+	static constexpr int32_t	maxSide		= 16384;		///< The maximal width and height of a requested image in pixels
+	static constexpr int64_t	maxPixels	= 1 << 26;		///< The maximal number of pixels of a requested image
+	static constexpr int32_t	maxSamples	= 4096;			///< The maximal number of samples per pixel of a request
+
+	/**
+	 * @brief Constructor
+	 * @param scenes The factories of the scenes, which may be requested, keyed by the scene names
+	 * @param nWorkers The number of worker threads. If zero, one worker per hardware thread is started
+	 * @param tileSize The size of the tiles in pixels. It is the granularity of the scheduling
+	 */
+	CRenderServer(const std::map<std::string, scene_factory_t>& scenes, size_t nWorkers = 0, Size tileSize = Size(32, 32))
+		: m_tileSize(tileSize)
+	{
+		for (const auto& [name, factory] : scenes) m_scenes[name].factory = factory;
+		if (nWorkers == 0) nWorkers = MAX(1u, std::thread::hardware_concurrency());
+		for (size_t i = 0; i < nWorkers; i++) m_vWorkers.emplace_back([this] { work(); });
+	}
+	CRenderServer(const CRenderServer&) = delete;
+	~CRenderServer(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_cvWork.notify_all();
+		for (auto& worker : m_vWorkers) worker.join();
+	}
+	const CRenderServer& operator=(const CRenderServer&) = delete;
+
+	/**
+	 * @brief Renders a request
+	 * @details This function may be called concurrently from multiple threads. It blocks until the image is ready
+	 * @param request The request
+	 * @return The rendered image of type CV_32FC3 or an empty image, if the scene is unknown or the request is invalid,
+	 * i.e. its resolution or number of samples is not positive or exceeds the limits (Ref. maxSide, maxPixels and maxSamples)
+	 */
+	Mat render(const Request& request)
+	{
+		if (request.width <= 0 || request.height <= 0 || request.samples <= 0) return Mat();
+		if (request.width > maxSide || request.height > maxSide || static_cast<int64_t>(request.width) * request.height > maxPixels || request.samples > maxSamples) return Mat();
+		CScene* pScene = getScene(std::string(request.scene, strnlen(request.scene, sizeof(request.scene))));
+		if (!pScene) return Mat();
+
+		Size resolution(request.width, request.height);
+		Job job(*pScene, m_tileSize);
+		job.renderer.setCamera(std::make_shared<CCameraPerspective>(resolution, Vec3f(request.pos[0], request.pos[1], request.pos[2]),
+			Vec3f(request.dir[0], request.dir[1], request.dir[2]), Vec3f(request.up[0], request.up[1], request.up[2]), request.angle));
+		job.img = Mat(resolution, CV_32FC3);
+		job.nTilesX = (resolution.width + m_tileSize.width - 1) / m_tileSize.width;
+		job.nTiles = job.nTilesX * ((resolution.height + m_tileSize.height - 1) / m_tileSize.height);
+		job.samples = request.samples;
+		if (job.samples > 1) job.sampleImg = Mat(resolution, CV_32FC3);
+		job.priority = request.priority;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		job.order = m_nJobs++;
+		m_vpQueue.push_back(&job);
+		m_cvWork.notify_all();
+		m_cvDone.wait(lock, [&job] { return job.nTilesDone == job.nTiles; });
+		return job.img;
+	}
+
+	/**
+	 * @brief Serves the requests on a Unix domain socket
+	 * @details Every client connection is served by its own thread, which may send any number of requests one after another.
+	 * The threads and the sockets of the closed connections are released while serving. A request, which fails (e.g. out of memory),
+	 * is answered with an empty image, and the connection is kept. The function returns, when a client sends a request with an empty scene name
+	 * @param socketPath The file system path of the socket
+	 * @retval true If the server was shut down by a client
+	 * @retval false If the socket can not be created
+	 */
+	bool serve(const std::string& socketPath)
+	{
+#ifndef _WIN32
+		int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+		unlink(socketPath.c_str());
+		if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listener, 64) < 0) {
+			printf("ERROR: Can't listen on socket %s\n", socketPath.c_str());
+			if (listener >= 0) close(listener);
+			return false;
+		}
+		printf("Render server is listening on %s with %zu workers\n", socketPath.c_str(), m_vWorkers.size());
+		fflush(stdout);
+
+		std::list<Connection> connections;
+		std::atomic<bool> stop{ false };
+		int backoff = 0;					// the delay after a failed accept in milliseconds
+		while (!stop) {
+			// release the closed connections
+			for (auto it = connections.begin(); it != connections.end();)
+				if (it->done) {
+					it->thread.join();
+					close(it->socket);
+					it = connections.erase(it);
+				} else it++;
+
+			pollfd fd{ listener, POLLIN, 0 };
+			if (poll(&fd, 1, 200) <= 0) continue;
+			int s = accept(listener, nullptr, nullptr);
+			if (s < 0) {
+				// e.g. out of file descriptors: the pending connection stays in the backlog, thus poll() would report it at once again
+				if (errno != EINTR && errno != ECONNABORTED) {
+					if (backoff == 0) printf("Warning: Can't accept a connection: %s\n", strerror(errno));
+					backoff = MIN(MAX(2 * backoff, 10), 1000);
+					std::this_thread::sleep_for(std::chrono::milliseconds(backoff));
+				}
+				continue;
+			}
+			backoff = 0;
+			Connection& connection = connections.emplace_back();
+			connection.socket = s;
+			connection.thread = std::thread([this, &connection, &stop] {
+				serveConnection(connection.socket, stop);
+				connection.done = true;
+			});
+		}
+		close(listener);
+		unlink(socketPath.c_str());
+		// wake up the connections, waiting for the next request; the rendered images are still sent
+		for (auto& connection : connections) ::shutdown(connection.socket, SHUT_RD);
+		for (auto& connection : connections) {
+			connection.thread.join();
+			close(connection.socket);
+		}
+		return true;
+#else
+		printf("Warning: The render server is not supported on this platform!\n");
+		return false;
+#endif
+	}
+
+	/**
+	 * @brief Sends a request to the render server and waits for the image
+	 * @param socketPath The file system path of the server socket
+	 * @param request The request. A request with an empty scene name shuts the server down
+	 * @return The rendered image of type CV_32FC3 or an empty image, if the request failed
+	 */
+	static Mat request(const std::string& socketPath, const Request& request)
+	{
+		Mat res;
+#ifndef _WIN32
+		int s = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+		if (s < 0 || connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+			printf("ERROR: Can't connect to the render server %s\n", socketPath.c_str());
+			if (s >= 0) close(s);
+			return res;
+		}
+		int32_t header[2] = { 0, 0 };
+		if (sendAll(s, &request, sizeof(request)) && request.scene[0] != '\0' && recvAll(s, header, sizeof(header)) && header[0] > 0 && header[1] > 0) {
+			Mat img(Size(header[0], header[1]), CV_32FC3);
+			if (recvAll(s, img.data, img.total() * img.elemSize())) res = img;
+		}
+		close(s);
+#else
+		printf("Warning: The render server is not supported on this platform!\n");
+#endif
+		return res;
+	}
+
+
+private:
+	/// Resident scene
+	struct Scene
+	{
+		scene_factory_t				factory;		///< The function, which populates the scene
+		std::unique_ptr<CScene>		pScene;			///< The scene or nullptr, if it is not built yet
+		std::once_flag				built;			///< Guards building of the scene
+	};
+
+	/// Client connection of the server
+	struct Connection
+	{
+		int					socket = -1;		///< The socket of the connection
+		std::thread			thread;				///< The thread, serving the connection
+		std::atomic<bool>	done{ false };		///< Whether the client has closed the connection
+	};
+
+	/// Request in progress
+	struct Job
+	{
+		Job(CScene& scene, Size tileSize) : renderer(scene, tileSize) {}
+
+		CRendererImmediate	renderer;			///< The renderer with the camera of the request
+		Mat					img;				///< The image
+		Mat					sampleImg;			///< The image of the current sample of every tile, if there are several samples per pixel
+		int					nTilesX = 0;		///< The number of tiles in a row
+		int					nTiles = 0;			///< The number of tiles
+		int					nTilesTaken = 0;	///< The number of tiles, taken by the workers
+		int					nTilesDone = 0;		///< The number of rendered tiles
+		int					samples = 1;		///< The number of samples per pixel
+		int					priority = 0;		///< The priority
+		size_t				order = 0;			///< The arrival order
+	};
+
+	// Returns the scene, building it on the first call, or nullptr if the scene is unknown
+	CScene* getScene(const std::string& name)
+	{
+		auto it = m_scenes.find(name);
+		if (it == m_scenes.end()) return nullptr;
+		Scene& scene = it->second;
+		std::call_once(scene.built, [&scene, &name] {
+			int64 ticks = getTickCount();
+			scene.pScene = std::make_unique<CScene>();
+			scene.factory(*scene.pScene);
+			printf("Scene \"%s\" is resident: %.1f ms\n", name.c_str(), 1000.0 * (getTickCount() - ticks) / getTickFrequency());
+		});
+		return scene.pScene.get();
+	}
+
+	// The worker thread
+	void work(void)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;) {
+			m_cvWork.wait(lock, [this] { return m_stop || !m_vpQueue.empty(); });
+			if (m_stop) return;
+
+			// the highest priority, then the oldest request
+			auto it = std::min_element(m_vpQueue.begin(), m_vpQueue.end(), [](const Job* a, const Job* b) {
+				return a->priority != b->priority ? a->priority > b->priority : a->order < b->order;
+			});
+			Job& job = **it;
+			int t = job.nTilesTaken++;
+			if (job.nTilesTaken == job.nTiles) m_vpQueue.erase(it);
+			lock.unlock();
+
+			int x = (t % job.nTilesX) * m_tileSize.width;
+			int y = (t / job.nTilesX) * m_tileSize.height;
+			Rect tile(x, y, MIN(m_tileSize.width, job.img.cols - x), MIN(m_tileSize.height, job.img.rows - y));
+			renderTile(job, tile);
+
+			lock.lock();
+			if (++job.nTilesDone == job.nTiles) m_cvDone.notify_all();
+		}
+	}
+
+	// Renders all the samples of a tile of the job and averages them. The tile is not larger than the tile of the renderer,
+	// thus it is rendered by the calling worker itself
+	static void renderTile(Job& job, const Rect& tile)
+	{
+		job.renderer.render(tile, job.img);
+		if (job.samples == 1) return;
+		Mat sum = job.img(tile);
+		for (int s = 1; s < job.samples; s++) {
+			job.renderer.render(tile, job.sampleImg, s);
+			sum += job.sampleImg(tile);
+		}
+		sum *= 1.0 / job.samples;
+	}
+
+#ifndef _WIN32
+	// Serves the requests of a client connection until it is closed or a client requests the shutdown (Ref. serve())
+	void serveConnection(int s, std::atomic<bool>& stop)
+	{
+		Request request;
+		while (recvAll(s, &request, sizeof(request))) {
+			if (request.scene[0] == '\0') {
+				stop = true;
+				break;
+			}
+			int64 ticks = getTickCount();
+			Mat img;
+			try {
+				img = render(request);
+			} catch (const std::exception& e) {
+				printf("ERROR: Request \"%.64s\" %dx%d, %d spp failed: %s\n", request.scene, request.width, request.height, request.samples, e.what());
+			}
+			printf("Request \"%.64s\" %dx%d, %d spp, priority %d: %.1f ms\n", request.scene, request.width, request.height,
+				request.samples, request.priority, 1000.0 * (getTickCount() - ticks) / getTickFrequency());
+			fflush(stdout);
+			int32_t header[2] = { img.cols, img.rows };
+			if (!sendAll(s, header, sizeof(header)) || !sendAll(s, img.data, img.total() * img.elemSize())) break;
+		}
+	}
+
+	static bool sendAll(int s, const void* pData, size_t size)
+	{
+		const char* p = static_cast<const char*>(pData);
+		while (size > 0) {
+			ssize_t n = send(s, p, size, MSG_NOSIGNAL);
+			if (n <= 0) return false;
+			p += n;
+			size -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	static bool recvAll(int s, void* pData, size_t size)
+	{
+		char* p = static_cast<char*>(pData);
+		while (size > 0) {
+			ssize_t n = recv(s, p, size, 0);
+			if (n <= 0) return false;
+			p += n;
+			size -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+#endif
+
+
+private:
+	Size								m_tileSize;				///< The size of the tiles in pixels
+	std::map<std::string, Scene>		m_scenes;				///< The resident scenes, keyed by their names
+	std::vector<std::thread>			m_vWorkers;				///< The worker threads
+	std::mutex							m_mutex;				///< Guards the queue and the progress of the jobs
+	std::condition_variable				m_cvWork;				///< Signals the workers about new jobs
+	std::condition_variable				m_cvDone;				///< Signals the requests about finished jobs
+	std::vector<Job*>					m_vpQueue;				///< The jobs with tiles, which are not taken yet
+	size_t								m_nJobs = 0;			///< The number of received jobs
+	bool								m_stop = false;			///< The flag indicating that the workers should exit
+};
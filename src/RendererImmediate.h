@@ -0,0 +1,53 @@
+// Immediate mode Renderer class
+#pragma once
+
+#include "IRenderer.h"
+#include "RayTracer.h"
+
+// ================================ Immediate Renderer Class ================================
+/**
+ * @brief Immediate mode renderer class
+ * @details Every primary ray is traced and shaded right away, like in CScene::RayTrace(). The reflected and refracted rays
+ * are followed by the secondary ray tracer (Ref. CRayTracer)
+ */
+class CRendererImmediate : public IRenderer
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param scene Reference to the scene
+	 * @param tileSize The size of the image tiles in pixels
+	 * @param maxDepth The maximal number of the reflection and refraction bounces
+	 */
+	CRendererImmediate(CScene& scene, Size tileSize = Size(32, 32), size_t maxDepth = 8)
+		: IRenderer(scene, tileSize)
+		, m_tracer(scene, maxDepth)
+	{}
+	virtual ~CRendererImmediate(void) = default;
+
+
+protected:
+	virtual void renderTile(const Rect& tile, Mat& img, int sample) override
+	{
+		// cull the scene against the beam of the tile rays
+		auto frustum = getCamera()->getFrustum(tile);
+		std::optional<SceneBeam> beam = frustum ? std::make_optional(getScene().cull(frustum.value())) : std::nullopt;
+
+		CRenderContext& context = CRenderContext::get();
+		RayBatch& rays = context.getScratch<RayBatch>();
+		getCamera()->InitRays(tile, rays);
+
+		Ray ray;
+		for (int y = tile.y; y < tile.y + tile.height; y++)
+			for (int x = tile.x; x < tile.x + tile.width; x++) {
+				context.setSample(x, y, sample);
+				rays.getRay(static_cast<size_t>(y - tile.y) * tile.width + (x - tile.x), ray);
+				bool hit = beam ? getScene().intersect(ray, beam.value()) : getScene().intersect(ray);
+				img.at<Vec3f>(y, x) = hit ? m_tracer.shade(ray) : getScene().getBackgroundColor();
+			}
+	}
+
+
+private:
+	CRayTracer	m_tracer;		///< The secondary ray tracer
+};
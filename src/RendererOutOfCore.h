@@ -0,0 +1,67 @@
+// Out-of-core Renderer class
+#pragma once
+
+#include "IRenderer.h"
+#include "OutOfCoreMesh.h"
+#include "RayTracer.h"
+
+// ================================ Out-of-core Renderer Class ================================
+/**
+ * @brief Out-of-core renderer class
+ * @details Renders the scene together with an out-of-core mesh (Ref. COutOfCoreMesh). All the primary rays of a tile are first
+ * intersected with the in-core scene and then with the mesh as one batch, so that the mesh clusters are paged in at most once per tile.
+ * Large tiles reduce the cluster traffic.
+ * The reflection and refraction bounces are followed by the secondary ray tracer (Ref. CRayTracer).
+ * @note The shadow rays and the secondary rays are tested against the in-core scene only
+ */
+class CRendererOutOfCore : public IRenderer
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param scene Reference to the scene
+	 * @param mesh Reference to the out-of-core mesh
+	 * @param tileSize The size of the image tiles in pixels
+	 * @param maxDepth The maximal number of the reflection and refraction bounces
+	 */
+	CRendererOutOfCore(CScene& scene, const COutOfCoreMesh& mesh, Size tileSize = Size(256, 256), size_t maxDepth = 8)
+		: IRenderer(scene, tileSize)
+		, m_tracer(scene, maxDepth)
+		, m_mesh(mesh)
+	{}
+	virtual ~CRendererOutOfCore(void) = default;
+
+
+protected:
+	virtual void renderTile(const Rect& tile, Mat& img, int sample) override
+	{
+		CRenderContext& context = CRenderContext::get();
+		std::vector<Ray>& vRays = context.getScratch<std::vector<Ray>>();
+		vRays.resize(static_cast<size_t>(tile.area()));
+
+		auto frustum = getCamera()->getFrustum(tile);
+		std::optional<SceneBeam> beam = frustum ? std::make_optional(getScene().cull(frustum.value())) : std::nullopt;
+		RayBatch& rays = context.getScratch<RayBatch>();
+		getCamera()->InitRays(tile, rays);
+		for (size_t i = 0; i < vRays.size(); i++) {
+			Ray& ray = vRays[i];
+			rays.getRay(i, ray);
+			if (beam) getScene().intersect(ray, beam.value());
+			else getScene().intersect(ray);
+		}
+
+		m_mesh.intersect(vRays);
+
+		for (size_t i = 0; i < vRays.size(); i++) {
+			int x = tile.x + static_cast<int>(i) % tile.width;
+			int y = tile.y + static_cast<int>(i) / tile.width;
+			context.setSample(x, y, sample);
+			img.at<Vec3f>(y, x) = vRays[i].hit ? m_tracer.shade(vRays[i]) : getScene().getBackgroundColor();
+		}
+	}
+
+
+private:
+	CRayTracer				m_tracer;		///< The secondary ray tracer
+	const COutOfCoreMesh&	m_mesh;			///< The out-of-core mesh
+};
@@ -0,0 +1,235 @@
+// Temporal Reprojection Renderer class
+#pragma once
+
+#include "IRenderer.h"
+#include "RayTracer.h"
+
+// ================================ Reprojection Renderer Class ================================
+/**
+ * @brief Temporal reprojection renderer class
+ * @details Renders a sequence of frames, e.g. a camera path, where every frame is seen by a new camera (Ref. setCamera()).
+ * The renderer caches the hit point, the hit primitive and the color of every pixel. Before a frame is rendered, the cached hit points
+ * of the previous frame are reprojected into the new view (Ref. ICamera::project()); the nearest point wins, if several points fall into the same pixel.
+ * A reprojected pixel is accepted, if the ray through its center hits the cached primitive at about the reprojected depth, which costs
+ * a single ray-primitive intersection instead of the traversal of the scene. Its color is reused without shading.
+ * The rays, which missed the scene, are reprojected by their directions; such a pixel is accepted as background, if no surface nor disoccluded pixel
+ * is next to it, since the surfaces may grow into the background by a pixel or so from frame to frame. The pixels at the region border are traced too,
+ * thus the objects, entering the view, are found.
+ * The disoccluded pixels, i.e. the pixels without a reprojected point, and the rejected pixels are traced anew.
+ * Since the acceptance test does not see the occluders, which were not visible in the previous frame, nor the view-dependent shading,
+ * a fraction of the accepted pixels (the validation rate) is traced anyway: if the traced primitive differs from the cached one, or the color
+ * differs by more than a tolerance, the whole tile is traced anew; otherwise the traced color refreshes the cached one.
+ * A higher rate finds the stale regions sooner at a higher cost; the rate of 1 traces every pixel and yields the same image as CRendererImmediate.
+ * @note The scene must not change between the frames, otherwise the cache should be invalidated (Ref. invalidate())
+ */
+class CRendererReprojection : public IRenderer
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param scene Reference to the scene
+	 * @param validationRate The fraction of the accepted pixels, which are traced for validation, in range [0; 1]
+	 * @param tileSize The size of the image tiles in pixels
+	 * @param maxDepth The maximal number of the reflection and refraction bounces
+	 */
+	CRendererReprojection(CScene& scene, float validationRate = 0.05f, Size tileSize = Size(32, 32), size_t maxDepth = 8)
+		: IRenderer(scene, tileSize)
+		, m_tracer(scene, maxDepth)
+		, m_validationRate(validationRate)
+	{}
+	virtual ~CRendererReprojection(void) = default;
+
+	/**
+	 * @brief Discards the cached frame, thus the next frame is traced completely
+	 */
+	void invalidate(void) { m_vCache.clear(); }
+	/**
+	 * @brief Sets the validation rate
+	 * @param validationRate The fraction of the accepted pixels, which are traced for validation, in range [0; 1]
+	 */
+	void setValidationRate(float validationRate) { m_validationRate = validationRate; }
+	/**
+	 * @brief Returns the fraction of the pixels of the last frame, which were traced
+	 * @returns The number of the traced pixels, including the validated ones, divided by the number of the rendered pixels
+	 */
+	float getTracedFraction(void) const { return m_nPixels ? static_cast<float>(m_nTraced) / m_nPixels : 0.0f; }
+
+
+protected:
+	virtual void beginFrame(const Rect& region) override
+	{
+		TRACE_SCOPE("reprojection");
+		const ptr_camera_t pCamera = getCamera();
+		const Size resolution = pCamera->getResolution();
+		const size_t nPixels = static_cast<size_t>(resolution.area());
+		std::swap(m_vPrevious, m_vCache);
+		m_vCache.resize(nPixels);
+		m_frame++;
+		m_nTraced = 0;
+		m_nPixels = static_cast<size_t>(region.area());
+		if (m_vPrevious.size() != nPixels) {		// the first frame or a new resolution
+			std::fill(m_vCache.begin(), m_vCache.end(), Sample());
+			return;
+		}
+
+		// scatter the hit points of the previous frame into the new view with the depth test. The depth and the index of the nearest point of a pixel
+		// are packed into one key, thus the test is an atomic minimum and the result does not depend on the order of the points
+		if (m_vKeys.size() != nPixels) m_vKeys = std::vector<std::atomic<qword>>(nPixels);
+		parallel_for_(Range(0, resolution.height), [&](const Range& range) {
+			for (size_t i = static_cast<size_t>(range.start) * resolution.width; i < static_cast<size_t>(range.end) * resolution.width; i++)
+				m_vKeys[i].store(m_noKey, std::memory_order_relaxed);
+		});
+		parallel_for_(Range(0, resolution.height), [&](const Range& range) {
+			Vec2f pixel;
+			float depth;
+			for (size_t i = static_cast<size_t>(range.start) * resolution.width; i < static_cast<size_t>(range.end) * resolution.width; i++) {
+				const Sample& sample = m_vPrevious[i];
+				if (!sample.pPrim && !sample.miss) continue;
+				// the missed rays are reprojected as the points at a far distance along their directions, which are farther than any surface
+				if (!pCamera->project(sample.miss ? m_farDistance * sample.point : sample.point, pixel, depth)) continue;
+				const int x = static_cast<int>(floorf(pixel[0]));
+				const int y = static_cast<int>(floorf(pixel[1]));
+				if (x < region.x || y < region.y || x >= region.x + region.width || y >= region.y + region.height) continue;
+				const float keyDepth = sample.miss ? Infty : depth;
+				dword depthBits;
+				memcpy(&depthBits, &keyDepth, sizeof(depthBits));		// the bits of the positive floats are ordered as the floats
+				const qword key = static_cast<qword>(depthBits) << 32 | i;
+				std::atomic<qword>& target = m_vKeys[static_cast<size_t>(y) * resolution.width + x];
+				qword current = target.load(std::memory_order_relaxed);
+				while (key < current && !target.compare_exchange_weak(current, key, std::memory_order_relaxed));
+			}
+		});
+		m_vMasks[0].assign(nPixels, 0);
+		m_vMasks[1].assign(nPixels, 0);
+		parallel_for_(Range(0, resolution.height), [&](const Range& range) {
+			for (size_t i = static_cast<size_t>(range.start) * resolution.width; i < static_cast<size_t>(range.end) * resolution.width; i++) {
+				const qword key = m_vKeys[i].load(std::memory_order_relaxed);
+				if (key == m_noKey) {
+					m_vCache[i] = Sample();
+					continue;
+				}
+				m_vCache[i] = m_vPrevious[key & 0xFFFFFFFF];
+				const dword depthBits = static_cast<dword>(key >> 32);
+				memcpy(&m_vCache[i].depth, &depthBits, sizeof(depthBits));
+				m_vMasks[0][i] = m_vCache[i].miss;
+			}
+		});
+
+		// the background pixels next to a surface, a disoccluded pixel or the region border are traced: the background mask is eroded by 3 x 3 pixels
+		parallel_for_(Range(region.y, region.y + region.height), [&](const Range& range) {
+			for (int y = range.start; y < range.end; y++) {
+				const byte* pMiss = m_vMasks[0].data() + static_cast<size_t>(y) * resolution.width;
+				byte* pRow = m_vMasks[1].data() + static_cast<size_t>(y) * resolution.width;
+				for (int x = region.x + 1; x < region.x + region.width - 1; x++)
+					pRow[x] = pMiss[x - 1] & pMiss[x] & pMiss[x + 1];
+			}
+		});
+		parallel_for_(Range(region.y, region.y + region.height), [&](const Range& range) {
+			for (int y = MAX(range.start, region.y + 1); y < MIN(range.end, region.y + region.height - 1); y++) {
+				const byte* pRow = m_vMasks[1].data() + static_cast<size_t>(y) * resolution.width;
+				Sample* pSample = m_vCache.data() + static_cast<size_t>(y) * resolution.width;
+				for (int x = region.x; x < region.x + region.width; x++)
+					pSample[x].miss = pRow[x - resolution.width] & pRow[x] & pRow[x + resolution.width];
+			}
+		});
+		for (int x = region.x; x < region.x + region.width; x++) {
+			m_vCache[static_cast<size_t>(region.y) * resolution.width + x].miss = false;
+			m_vCache[static_cast<size_t>(region.y + region.height - 1) * resolution.width + x].miss = false;
+		}
+	}
+
+	virtual void renderTile(const Rect& tile, Mat& img, int sample) override
+	{
+		const ptr_camera_t pCamera = getCamera();
+		const int width = pCamera->getResolution().width;
+		CRenderContext& context = CRenderContext::get();
+		RayBatch& rays = context.getScratch<RayBatch>();
+		pCamera->InitRays(tile, rays);
+
+		// accept the reprojected pixels, which pass the test, and validate some of them
+		std::vector<byte>& vAccepted = context.getScratch<std::vector<byte>>();
+		vAccepted.assign(rays.size(), 0);
+		size_t nTraced = 0;
+		bool valid = true;
+		Ray ray;
+		for (int y = tile.y; y < tile.y + tile.height && valid; y++)
+			for (int x = tile.x; x < tile.x + tile.width && valid; x++) {
+				const size_t i = static_cast<size_t>(y - tile.y) * tile.width + (x - tile.x);
+				Sample& cached = m_vCache[static_cast<size_t>(y) * width + x];
+				if (cached.pPrim) {
+					rays.getRay(i, ray);
+					if (!cached.pPrim->intersect(ray) || fabsf(ray.t - cached.depth) > m_depthTolerance * cached.depth) continue;
+					cached.point = ray.org + ray.t * ray.dir;
+					cached.depth = ray.t;
+				}
+				else if (!cached.miss) continue;
+				vAccepted[i] = 1;
+				if (!isValidated(x, y)) continue;
+				nTraced++;
+				context.setSample(x, y, sample);
+				rays.getRay(i, ray);
+				const Vec3f color = trace(ray);
+				const Vec3f diff = color - cached.color;
+				valid = ray.hit.get() == cached.pPrim && MAX(fabsf(diff[0]), MAX(fabsf(diff[1]), fabsf(diff[2]))) <= m_colorTolerance;
+				cached.color = color;		// the slowly changing colors are refreshed by the validation
+			}
+		if (!valid) std::fill(vAccepted.begin(), vAccepted.end(), 0);
+
+		// trace the rest
+		for (int y = tile.y; y < tile.y + tile.height; y++)
+			for (int x = tile.x; x < tile.x + tile.width; x++) {
+				const size_t i = static_cast<size_t>(y - tile.y) * tile.width + (x - tile.x);
+				Sample& cached = m_vCache[static_cast<size_t>(y) * width + x];
+				if (!vAccepted[i]) {
+					nTraced++;
+					context.setSample(x, y, sample);
+					rays.getRay(i, ray);
+					cached.color = trace(ray);
+					cached.pPrim = ray.hit.get();
+					cached.miss = !ray.hit;
+					cached.point = ray.hit ? ray.org + ray.t * ray.dir : ray.dir;
+					cached.depth = ray.t;
+				}
+				img.at<Vec3f>(y, x) = cached.color;
+			}
+		m_nTraced += nTraced;
+	}
+
+
+private:
+	/// Cached pixel
+	struct Sample
+	{
+		Vec3f			point;				///< The hit point in WCS or the direction of the missed ray
+		const IPrim*	pPrim = nullptr;	///< The hit primitive or nullptr, if the ray missed the scene or the pixel was not reprojected
+		bool			miss = false;		///< Whether the ray missed the scene
+		float			depth = 0;			///< The distance from the camera origin to the hit point
+		Vec3f			color;				///< The color of the pixel
+	};
+
+	// Traces and shades the primary ray
+	Vec3f trace(Ray& ray) const { return getScene().intersect(ray) ? m_tracer.shade(ray) : getScene().getBackgroundColor(); }
+	// Checks whether the accepted pixel (x, y) is traced for validation in the current frame
+	bool isValidated(int x, int y) const
+	{
+		const qword key = CRandom::mix(CRandom::mix(m_frame) ^ (static_cast<qword>(static_cast<dword>(y)) << 32 | static_cast<dword>(x)));
+		return (key >> 40) * (1.0f / (1 << 24)) < m_validationRate;
+	}
+
+
+private:
+	static constexpr float	m_depthTolerance = 0.01f;	///< The maximal relative difference of the depths of an accepted pixel
+	static constexpr float	m_colorTolerance = 0.05f;	///< The maximal difference of the color channels of a validated pixel, which does not invalidate its tile
+	static constexpr float	m_farDistance = 1e6f;		///< The distance, at which the missed rays are reprojected
+	static constexpr qword	m_noKey = ~0ULL;			///< The key of a pixel without a reprojected point
+
+	CRayTracer				m_tracer;					///< The secondary ray tracer
+	float					m_validationRate;			///< The fraction of the accepted pixels, which are traced for validation
+	std::vector<Sample>		m_vCache;					///< The pixels of the current frame
+	std::vector<Sample>		m_vPrevious;				///< The pixels of the previous frame
+	std::vector<std::atomic<qword>>	m_vKeys;			///< The depth and the index of the nearest reprojected point per pixel
+	std::vector<byte>		m_vMasks[2];				///< The background pixels and the background pixels, whose row neighbors are background too
+	qword					m_frame = 0;				///< The index of the current frame
+	std::atomic<size_t>		m_nTraced{ 0 };				///< The number of the traced pixels of the current frame
+	size_t					m_nPixels = 0;				///< The number of the rendered pixels of the current frame
+};
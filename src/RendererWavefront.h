@@ -0,0 +1,130 @@
+// Wavefront (deferred shading) Renderer class
+#pragma once
+
+#include "IRenderer.h"
+#include "PerfCounters.h"
+#include "RaySorter.h"
+#include "RayTracer.h"
+
+// ================================ Wavefront Renderer Class ================================
+/**
+ * @brief Wavefront renderer class
+ * @details The renderer processes a whole tile in stages: first all the primary rays of the tile are traced and
+ * the hits are recorded, then the hits are sorted by their shaders and every shader shades its hits in one tight loop
+ * (Ref. IShader::shadeDeferred()). The shadow rays generated during shading are collected and traced afterwards as one batch,
+ * sorted by their origins and directions (Ref. CRaySorter). The reflection and refraction bounces of the hits, whose shaders scatter
+ * (Ref. IShader::scatter()), are followed by the secondary ray tracer (Ref. CRayTracer) right after the hits are shaded.
+ * Large tiles keep the instruction cache hot, when the scene has many materials.
+ * @note The shaded colors are saturated to 1 after the shadow rays are resolved
+ */
+class CRendererWavefront : public IRenderer
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param scene Reference to the scene
+	 * @param tileSize The size of the image tiles in pixels
+	 * @param sortRays The flag indicating whether the shadow rays should be sorted before tracing
+	 * @param maxDepth The maximal number of the reflection and refraction bounces
+	 */
+	CRendererWavefront(CScene& scene, Size tileSize = Size(128, 128), bool sortRays = true, size_t maxDepth = 8)
+		: IRenderer(scene, tileSize)
+		, m_tracer(scene, maxDepth)
+		, m_sortRays(sortRays)
+	{}
+	virtual ~CRendererWavefront(void) = default;
+
+
+protected:
+	virtual void renderTile(const Rect& tile, Mat& img, int sample) override
+	{
+		CRenderContext& context = CRenderContext::get();
+		Buffers& buf = context.getScratch<Buffers>();
+
+		const size_t nRays = static_cast<size_t>(tile.area());
+		buf.vRays.resize(nRays);
+		buf.vColors.assign(nRays, getScene().getBackgroundColor());
+		buf.vHits.clear();
+		buf.vShadowRays.clear();
+
+		// Stage 1: trace the primary rays and record the hits
+		{
+			PERF_SCOPE(PerfStage::traversal);
+			auto frustum = getCamera()->getFrustum(tile);
+			std::optional<SceneBeam> beam = frustum ? std::make_optional(getScene().cull(frustum.value())) : std::nullopt;
+			getCamera()->InitRays(tile, buf.rayBatch);
+			for (size_t i = 0; i < nRays; i++) {
+				Ray& ray = buf.vRays[i];
+				buf.rayBatch.getRay(i, ray);
+				if (beam ? getScene().intersect(ray, beam.value()) : getScene().intersect(ray))
+					buf.vHits.push_back(HitRecord{ ray.hit->getShader().get(), i });
+			}
+		}
+
+		{
+			PERF_SCOPE(PerfStage::shading);
+			// Stage 2: bin the hits by their shaders
+			std::sort(buf.vHits.begin(), buf.vHits.end(), [](const HitRecord& a, const HitRecord& b) {
+				return a.pShader != b.pShader ? std::less<const IShader*>()(a.pShader, b.pShader) : a.index < b.index;
+			});
+
+			// Stage 3: shade every bin in a batch, collecting the shadow rays, and follow the secondary rays of the scattering shaders
+			for (auto it = buf.vHits.begin(); it != buf.vHits.end(); ) {
+				const IShader* pShader = it->pShader;
+				for (; it != buf.vHits.end() && it->pShader == pShader; it++) {
+					context.setSample(tile.x + static_cast<int>(it->index) % tile.width, tile.y + static_cast<int>(it->index) / tile.width, sample);
+					size_t nShadowRays = buf.vShadowRays.size();
+					buf.vColors[it->index] = ShaderDispatch::shadeDeferred(buf.vRays[it->index], buf.vShadowRays);
+					for (size_t s = nShadowRays; s < buf.vShadowRays.size(); s++)
+						buf.vShadowRays[s].index = it->index;
+					buf.vColors[it->index] += m_tracer.traceSecondary(buf.vRays[it->index]);
+				}
+			}
+		}
+
+		// Stage 4: trace the shadow rays as one batch
+		{
+			PERF_SCOPE(PerfStage::traversal);
+			if (m_sortRays) {
+				for (dword s : buf.sorter.sort(buf.vShadowRays, [](const ShadowRay& shadowRay) -> const Ray& { return shadowRay.ray; }))
+					if (!getScene().occluded(buf.vShadowRays[s].ray))
+						buf.vColors[buf.vShadowRays[s].index] += buf.vShadowRays[s].contribution;
+			} else
+				for (auto& shadowRay : buf.vShadowRays)
+					if (!getScene().occluded(shadowRay.ray))
+						buf.vColors[shadowRay.index] += shadowRay.contribution;
+		}
+
+		// Write the tile
+		for (size_t i = 0; i < nRays; i++) {
+			Vec3f& color = img.at<Vec3f>(tile.y + static_cast<int>(i) / tile.width, tile.x + static_cast<int>(i) % tile.width);
+			for (int c = 0; c < 3; c++)
+				color.val[c] = MIN(buf.vColors[i].val[c], 1.0f);
+		}
+	}
+
+
+private:
+	/// Compact hit record
+	struct HitRecord
+	{
+		const IShader*	pShader;	///< The shader of the hit primitive
+		size_t			index;		///< The index of the ray in the tile
+	};
+
+	/// Per-thread tile buffers (Ref. CRenderContext::getScratch())
+	struct Buffers
+	{
+		RayBatch				rayBatch;		///< The primary rays of the tile, generated by the camera
+		std::vector<Ray>		vRays;			///< The primary rays of the tile and their hits
+		std::vector<Vec3f>		vColors;		///< The colors of the tile pixels
+		std::vector<HitRecord>	vHits;			///< The hit records of the tile
+		std::vector<ShadowRay>	vShadowRays;	///< The shadow rays queue
+		CRaySorter				sorter;			///< The sorter of the shadow rays
+	};
+
+
+private:
+	CRayTracer	m_tracer;		///< The secondary ray tracer
+	bool		m_sortRays;		///< The flag indicating whether the shadow rays are sorted before tracing
+};
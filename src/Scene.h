@@ -6,10 +6,25 @@
 #include "IPrim.h"
 #include "ICamera.h"
 #include "Solid.h"
+#include "SolidLOD.h"
+#include "LightBVH.h"
+#include "PerfCounters.h"
+#include "Tracer.h"
+#include "Numa.h"
 #ifdef ENABLE_BSP
 #include "BSPTree.h"
 #endif
 
+/// The part of the scene, which may be hit by the rays of a beam (Ref. CScene::cull())
+struct SceneBeam
+{
+#ifdef ENABLE_BSP
+	BSPEntry					entry;		///< The traversal entry point of the BSP tree
+#else
+	std::vector<ptr_prim_t>		vpPrims;	///< The primitives, which may be hit by the rays of the beam
+#endif
+};
+
 // ================================ Scene Class ================================
 /**
  * @brief Scene class
@@ -24,10 +39,11 @@ public:
 	 */
 	CScene(Vec3f bgColor = RGB(0, 0, 0))
 		: m_bgColor(bgColor)
-#ifdef ENABLE_BSP	
-		, m_pBSPTree(new CBSPTree())
+	{
+#ifdef ENABLE_BSP
+		m_vpBSPTrees.push_back(std::make_unique<CBSPTree>());
 #endif
-	{}
+	}
 	~CScene(void) = default;
 
 	/**
@@ -61,30 +77,164 @@ public:
 	 */
 	void add(const CSolid& solid)
 	{
-		// --- PUT YOUR CODE HERE ---
+		for (const auto& pPrim : solid.getPrims())
+			add(pPrim);
+	}
+	/**
+	 * @brief Adds a solid with several levels of detail to the scene
+	 * @details The level is chosen for the active camera (Ref. CSolidLOD::selectLevel()), thus the camera should be added first.
+	 * Without a camera the finest level is added
+	 * @param solid The reference to the solid
+	 */
+	void add(const CSolidLOD& solid)
+	{
+		ptr_camera_t pCamera = getActiveCamera();
+		ptr_prim_t pPrim = solid.getPrim(pCamera ? solid.selectLevel(*pCamera) : 0);
+		if (pPrim) add(pPrim);
 	}
 	/**
 	 * @brief (Re-) Build the BSP tree for the current geometry present in scene
-	 * @details This function takes into accound all the primitives in scene and builds the BSP tree with the root node in \b m_pBSPTree variable.
+	 * @details This function takes into accound all the bounded primitives in scene and builds the BSP tree with the root node in \b m_vpBSPTrees variable.
+	 * The unbounded primitives (e.g. planes) would overlap every node of the tree; they are kept in a separate list instead and tested once per ray
+	 * after the tree traversal. In the replicate NUMA mode (Ref. CNuma) every node gets its own copy of the tree.
 	 * If the geometry in the scene was updated the BSP tree should be re-built
 	 * @param maxDepth The maximum allowed depth of the tree.
 	 * Increasing the depth of the tree may speed-up rendering, but increse the memory consumption.
+	 * Zero value derives the depth from the number and the distribution of the primitives
 	 * @param minPrimitives The minimum number of primitives in a leaf-node.
-	 * This parameters should be alway above 1.
+	 * This parameters should be alway above 1. Zero value derives the number from the number of the primitives
+	 * @param lazy The flag indicating whether the BSP sub-trees should be built on demand, i.e. when the rays enter them for the first time.
+	 * It reduces the time to the first pixel, if only a part of the scene is visible
 	 */
-	void buildAccelStructure(size_t maxDepth, size_t minPrimitives) {
+	void buildAccelStructure(size_t maxDepth = 0, size_t minPrimitives = 0, bool lazy = false) {
+		PERF_SCOPE(PerfStage::build);
+		TRACE_SCOPE("BSP build");
 #ifdef ENABLE_BSP
-		m_pBSPTree->build(m_vpPrims, maxDepth, minPrimitives);
+		std::vector<ptr_prim_t> vpBoundedPrims;
+		m_vpUnboundedPrims.clear();
+		for (const auto& pPrim : m_vpPrims)
+			(pPrim->getBoundingBox().isBounded() ? vpBoundedPrims : m_vpUnboundedPrims).push_back(pPrim);
+		buildBSPTrees(vpBoundedPrims, maxDepth, minPrimitives, lazy);
+		const CBSPTree& tree = *m_vpBSPTrees.front();
+		std::cout << "Scene bounds are : " << tree.getBoundingBox() << std::endl;
+		printf("BSP parameters: max depth %zu%s, min primitives %zu%s\n", tree.getMaxDepth(), maxDepth ? "" : " (auto)",
+			tree.getMinPrimitives(), minPrimitives ? "" : " (auto)");
+		if (m_vpBSPTrees.size() > 1) printf("BSP tree is replicated on %zu NUMA nodes\n", m_vpBSPTrees.size());
+		if (!lazy) printAccelStructureStats();
 #else 
 		printf("Warning: BSP support is not enabled!\n");
 #endif		
 	}
+	/**
+	 * @brief Tunes the parameters of the BSP tree by tracing a sample of rays
+	 * @details Starting from the parameters of the current tree (Ref. buildAccelStructure()), the trees with a few candidate
+	 * configurations are built: shallower and deeper ones, and ones with smaller and larger leaves. The same random sample of the primary
+	 * rays of the active camera is traced through every candidate in the calling thread, and the tree of the fastest candidate is kept.
+	 * The build time, the trace time and the memory of every candidate are logged. The candidates are built eagerly; the kept tree is
+	 * built lazily again, if the current one is. If the tree is not built yet, it is built with the derived parameters first.
+	 * @note The calibration builds several trees, thus it pays off for the long renders (e.g. animations) only
+	 * @param nRays The number of sample rays
+	 */
+	void calibrateAccelStructure(size_t nRays = 4096) {
+#ifdef ENABLE_BSP
+		TRACE_SCOPE("BSP calibration");
+		ptr_camera_t pCamera = getActiveCamera();
+		if (!pCamera || m_vpPrims.empty()) return;
+
+		std::vector<Ray> vRays(nRays);
+		RNG rng;
+		const Size resolution = pCamera->getResolution();
+		for (Ray& ray : vRays)
+			pCamera->InitRay(ray, rng.uniform(0, resolution.width), rng.uniform(0, resolution.height));
+
+		CBSPTree& tree = *m_vpBSPTrees.front();
+		if (tree.getMaxDepth() == 0) buildAccelStructure();
+		if (tree.getMaxDepth() == 0) return;
+		const size_t depth = tree.getMaxDepth();
+		const size_t leaf = tree.getMinPrimitives();
+		const bool lazy = tree.isLazy();
+		std::vector<std::pair<size_t, size_t>> vCandidates = { { depth, leaf }, { depth - MIN(depth - 1, size_t(4)), leaf }, { depth + 4, leaf }, { depth, leaf + 2 } };
+		if (leaf > 2) vCandidates.emplace_back(depth, leaf - 1);
+
+		std::vector<ptr_prim_t> vpBoundedPrims;
+		for (const auto& pPrim : m_vpPrims)
+			if (pPrim->getBoundingBox().isBounded()) vpBoundedPrims.push_back(pPrim);
+
+		std::pair<size_t, size_t> best = vCandidates.front();
+		double bestTime = std::numeric_limits<double>::infinity();
+		for (const auto& candidate : vCandidates) {
+			int64 ticks = getTickCount();
+			tree.build(vpBoundedPrims, candidate.first, candidate.second);
+			double buildTime = 1000 * (getTickCount() - ticks) / getTickFrequency();
+
+			// the best of a few repetitions is taken, since the first one also warms up the caches
+			double traceTime = std::numeric_limits<double>::infinity();
+			for (int i = 0; i < 3; i++) {
+				ticks = getTickCount();
+				for (const Ray& ray : vRays)
+					intersect(lvalue_cast(Ray(ray)));
+				traceTime = MIN(traceTime, 1e6 * (getTickCount() - ticks) / getTickFrequency() / nRays);
+			}
+			printf("BSP candidate: max depth %zu, min primitives %zu: %.1f ms build, %.3f us per ray, %.1f bytes per primitive\n",
+				tree.getMaxDepth(), tree.getMinPrimitives(), buildTime, traceTime,
+				static_cast<double>(tree.getMemoryUsage()) / std::max<size_t>(1, vpBoundedPrims.size()));
+			if (traceTime < bestTime) {
+				bestTime = traceTime;
+				best = candidate;
+			}
+		}
+
+		buildBSPTrees(vpBoundedPrims, best.first, best.second, lazy);
+		const CBSPTree& bestTree = *m_vpBSPTrees.front();
+		printf("BSP calibration: max depth %zu, min primitives %zu, %.3f us per ray\n", bestTree.getMaxDepth(), bestTree.getMinPrimitives(), bestTime);
+		if (!lazy) printAccelStructureStats();
+#endif
+	}
+	/**
+	 * @brief Prints the size of the BSP tree
+	 * @note If the tree is built lazily, only the sub-trees built so far are counted. No rendering may run concurrently
+	 */
+	void printAccelStructureStats(void) const {
+#ifdef ENABLE_BSP
+		const CBSPTree& tree = *m_vpBSPTrees.front();
+		printf("BSP tree: %zu nodes, %.1f bytes per primitive, duplication factor %.2f, %zu unbounded primitives outside\n", tree.getNumNodes(),
+			static_cast<double>(tree.getMemoryUsage()) / std::max<size_t>(1, m_vpPrims.size() - m_vpUnboundedPrims.size()), tree.getDuplicationFactor(),
+			m_vpUnboundedPrims.size());
+#endif
+	}
+	/**
+	 * @brief (Re-) Build the light hierarchy for the light sources present in scene
+	 * @details After calling this function, the shaders estimate the direct illumination by sampling \b nSamples light sources per shading point
+	 * instead of evaluating every light source (Ref. @ref CLightBVH). If the lights in the scene were updated the hierarchy should be re-built.
+	 * @param nSamples The number of light samples per shading point. If the scene contains not more light sources than \b nSamples,
+	 * all the light sources are evaluated as usual. Zero value disables the light sampling.
+	 */
+	void buildLightStructure(size_t nSamples = 4) {
+		m_nLightSamples = nSamples;
+		m_pLightBVH->build(m_vpLights);
+	}
 	/**
 	 * @brief Returns the container with all scene light source objects
 	 * @note This method is to be used only in OpenRT shaders
 	 * @return The vector with pointers to the scene light sources
 	 */
-	const std::vector<ptr_light_t>	getLights(void) const { return m_vpLights; }
+	const std::vector<ptr_light_t>&	getLights(void) const { return m_vpLights; }
+	/**
+	 * @brief Returns the light hierarchy
+	 * @retval CLightBVH* The pointer to the light hierarchy, if the light sampling is enabled with buildLightStructure()
+	 * @retval nullptr If all the light sources are to be evaluated for every shading point
+	 */
+	const CLightBVH* getLightBVH(void) const { return (m_nLightSamples > 0 && m_pLightBVH->size() > m_nLightSamples) ? m_pLightBVH.get() : nullptr; }
+	/**
+	 * @brief Returns the number of light samples per shading point
+	 * @return The number of light samples per shading point
+	 */
+	size_t getNumLightSamples(void) const { return m_nLightSamples; }
+	/**
+	 * @brief Returns the background color
+	 * @return The background color
+	 */
+	Vec3f getBackgroundColor(void) const { return m_bgColor; }
 	/**
 	 * @brief Returns the active camera
 	 * @retval ptr_camera_t The pointer to active camera
@@ -100,7 +250,8 @@ public:
 	bool intersect(Ray& ray) const
 	{
 #ifdef ENABLE_BSP
-		return m_pBSPTree->intersect(ray);
+		bool hit = getBSPTree().intersect(ray);
+		return intersectUnbounded(ray) || hit;
 #else
 		bool hit = false;
 		for (auto& pPrim : m_vpPrims)
@@ -109,13 +260,51 @@ public:
 #endif
 	}
 
+	/**
+	 * @brief Culls the scene against a beam of rays
+	 * @details All the rays of the beam must be contained in the frustum \b frustum (Ref. ICamera::getFrustum())
+	 * @param frustum The frustum of the beam
+	 * @return The part of the scene, which may be hit by the rays of the beam
+	 */
+	SceneBeam cull(const CFrustum& frustum) const
+	{
+		SceneBeam res;
+#ifdef ENABLE_BSP
+		res.entry = getBSPTree().findEntry(frustum);
+#else
+		for (auto& pPrim : m_vpPrims)
+			if (frustum.overlaps(pPrim->getBoundingBox()))
+				res.vpPrims.push_back(pPrim);
+#endif
+		return res;
+	}
+	/**
+	 * @brief Checks intersection of ray \b ray, belonging to a beam, with the objects of the beam
+	 * @param ray The ray
+	 * @param beam The part of the scene, which may be hit by the rays of the beam (Ref. cull())
+	 * @retval true If ray \b ray intersects any object
+	 * @retval false otherwise
+	 */
+	bool intersect(Ray& ray, const SceneBeam& beam) const
+	{
+#ifdef ENABLE_BSP
+		bool hit = getBSPTree().intersect(ray, beam.entry);
+		return intersectUnbounded(ray) || hit;
+#else
+		bool hit = false;
+		for (auto& pPrim : beam.vpPrims)
+			hit |= pPrim->intersect(ray);
+		return hit;
+#endif
+	}
+
 	/**
 	 * find occluder
 	 */
 	bool occluded(Ray& ray)
 	{
 #ifdef ENABLE_BSP
-		return m_pBSPTree->intersect(lvalue_cast(Ray(ray)));
+		return intersect(lvalue_cast(Ray(ray)));
 #else
 		for (auto& pPrim : m_vpPrims)
 			if (pPrim->occluded(ray)) return true;
@@ -133,13 +322,52 @@ public:
 	}
 
 
+private:
+#ifdef ENABLE_BSP
+	// Builds the BSP tree of every NUMA node. In the replicate mode every copy is built by a thread, pinned to its node, thus the memory of the copy is allocated there
+	void buildBSPTrees(const std::vector<ptr_prim_t>& vpPrims, size_t maxDepth, size_t minPrimitives, bool lazy)
+	{
+		const size_t nTrees = CNuma::getMode() == NumaMode::replicate ? CNuma::getNumNodes() : 1;
+		m_vpBSPTrees.resize(nTrees);
+		// the existing trees are rebuilt in place, thus the references to them stay valid; build() releases the old nodes and allocates the new ones
+		for (auto& pTree : m_vpBSPTrees)
+			if (!pTree) pTree = std::make_unique<CBSPTree>();
+		if (nTrees == 1) {
+			m_vpBSPTrees.front()->build(vpPrims, maxDepth, minPrimitives, lazy);
+			return;
+		}
+		std::vector<std::thread> vThreads;
+		for (size_t node = 0; node < nTrees; node++)
+			vThreads.emplace_back([&, node] {
+				CNuma::pinThread(node);
+				m_vpBSPTrees[node]->build(vpPrims, maxDepth, minPrimitives, lazy);
+			});
+		for (auto& thread : vThreads)
+			thread.join();
+	}
+	// Returns the BSP tree of the NUMA node of the calling thread
+	const CBSPTree& getBSPTree(void) const { return *m_vpBSPTrees[MIN(CNuma::getNode(), m_vpBSPTrees.size() - 1)]; }
+	// Checks intersection of ray with the unbounded primitives. The hit in the BSP tree, if any, bounds ray.t already
+	bool intersectUnbounded(Ray& ray) const
+	{
+		bool hit = false;
+		for (const auto& pPrim : m_vpUnboundedPrims)
+			hit |= pPrim->intersect(ray);
+		return hit;
+	}
+#endif
+
+
 private:
 	Vec3f						m_bgColor;    			///< background color
 	std::vector<ptr_prim_t> 	m_vpPrims;				///< primitives
 	std::vector<ptr_light_t>	m_vpLights;				///< lights
 	std::vector<ptr_camera_t>	m_vpCameras;			///< Cameras
 	size_t						m_activeCamera = 0;	//< The index of the active camera
+	std::unique_ptr<CLightBVH>	m_pLightBVH = std::make_unique<CLightBVH>();	///< Pointer to the light hierarchy
+	size_t						m_nLightSamples = 0;	///< The number of light samples per shading point
 #ifdef ENABLE_BSP		
-	std::unique_ptr<CBSPTree>	m_pBSPTree = nullptr;	///< Pointer to the acceleration structure
+	std::vector<std::unique_ptr<CBSPTree>>	m_vpBSPTrees;	///< The acceleration structures: one per NUMA node in the replicate mode (Ref. CNuma), otherwise one
+	std::vector<ptr_prim_t>		m_vpUnboundedPrims;		///< The primitives with infinite extent, which are not included into the BSP tree
 #endif
 };
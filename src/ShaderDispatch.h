@@ -0,0 +1,106 @@
+// Closed-set shader dispatch functions
+#pragma once
+
+#include "Scene.h"
+#include "PrimSphere.h"
+#include "PrimPlane.h"
+#include "PrimTriangle.h"
+#include "ShaderFlat.h"
+#include "ShaderEyelight.h"
+#include "ShaderPhong.h"
+#include <typeinfo>
+
+/**
+ * @brief Shading entry points of the renderers
+ * @details If the closed-set shading mode is enabled (ENABLE_STATIC_DISPATCH), the shaders and primitives known to the framework
+ * are dispatched with a switch over their type tags (Ref. IShader::getType() and IPrim::getType()) and then called non-virtually,
+ * which allows the compiler to inline the shading code. User-defined shaders and primitives (with \b custom type tags)
+ * are handled through the virtual interface as usual. Since CShaderFlat is not final, a shader with the \b flat tag is dispatched statically only
+ * if its dynamic type is exactly CShaderFlat, thus the overrides of the user-defined classes derived from it are called. Otherwise, the virtual interface is used for all the shaders and primitives.
+ */
+namespace ShaderDispatch
+{
+	/**
+	 * @brief Returns the normal of the primitive \b prim in the ray - primitive intersection point
+	 * @param prim The primitive hit by the ray
+	 * @param ray Ray pointing at the surface
+	 * @return The normalized normal of the primitive
+	 */
+	inline Vec3f getNormal(const IPrim& prim, const Ray& ray)
+	{
+#ifdef ENABLE_STATIC_DISPATCH
+		switch (prim.getType()) {
+			case PrimType::triangle:	return static_cast<const CPrimTriangle&>(prim).CPrimTriangle::getNormal(ray);
+			case PrimType::sphere:		return static_cast<const CPrimSphere&>(prim).CPrimSphere::getNormal(ray);
+			case PrimType::plane:		return static_cast<const CPrimPlane&>(prim).CPrimPlane::getNormal(ray);
+			default: break;
+		}
+#endif
+		return prim.getNormal(ray);
+	}
+
+	/**
+	 * @brief Calculates the color of the hit by the ray \b ray object (Ref. IShader::shade())
+	 * @param ray The ray hitting the primitive. ray.hit must point to the primitive
+	 * @return The color of the hit object
+	 */
+	inline Vec3f shade(const Ray& ray)
+	{
+		const IShader& shader = *ray.hit->getShader();
+#ifdef ENABLE_STATIC_DISPATCH
+		switch (shader.getType()) {
+			case ShaderType::flat:
+				if (typeid(shader) == typeid(CShaderFlat)) return static_cast<const CShaderFlat&>(shader).CShaderFlat::shade(ray);
+				break;
+			case ShaderType::eyelight:	return static_cast<const CShaderEyelight&>(shader).shade(ray, getNormal(*ray.hit, ray));
+			case ShaderType::phong:		return static_cast<const CShaderPhong&>(shader).shade(ray, getNormal(*ray.hit, ray));
+			default: break;
+		}
+#endif
+		return shader.shade(ray);
+	}
+
+	/**
+	 * @brief Calculates the color of the hit by the ray \b ray object, deferring the visibility tests (Ref. IShader::shadeDeferred())
+	 * @param[in] ray The ray hitting the primitive. ray.hit must point to the primitive
+	 * @param[in,out] vShadowRays The container, where the shadow rays are appended to
+	 * @return The visibility-independent part of the color of the hit object
+	 */
+	inline Vec3f shadeDeferred(const Ray& ray, std::vector<ShadowRay>& vShadowRays)
+	{
+		const IShader& shader = *ray.hit->getShader();
+#ifdef ENABLE_STATIC_DISPATCH
+		switch (shader.getType()) {
+			case ShaderType::flat:
+				if (typeid(shader) == typeid(CShaderFlat)) return static_cast<const CShaderFlat&>(shader).CShaderFlat::shade(ray);
+				break;
+			case ShaderType::eyelight:	return static_cast<const CShaderEyelight&>(shader).shade(ray, getNormal(*ray.hit, ray));
+			case ShaderType::phong:		return static_cast<const CShaderPhong&>(shader).shadeDeferred(ray, getNormal(*ray.hit, ray), vShadowRays);
+			default: break;
+		}
+#endif
+		return shader.shadeDeferred(ray, vShadowRays);
+	}
+
+	/**
+	 * @brief Spawns the secondary rays at the hit point of the ray \b ray (Ref. IShader::scatter())
+	 * @param[in] ray The ray hitting the primitive. ray.hit must point to the primitive
+	 * @param[out] secondary The secondary rays
+	 * @return The number of the secondary rays written to \b secondary
+	 */
+	inline size_t scatter(const Ray& ray, std::array<SecondaryRay, 2>& secondary)
+	{
+		const IShader& shader = *ray.hit->getShader();
+#ifdef ENABLE_STATIC_DISPATCH
+		switch (shader.getType()) {
+			case ShaderType::flat:
+				if (typeid(shader) == typeid(CShaderFlat)) return 0;
+				break;
+			case ShaderType::eyelight:
+			case ShaderType::phong:		return 0;
+			default: break;
+		}
+#endif
+		return shader.scatter(ray, secondary);
+	}
+}
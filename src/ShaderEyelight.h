@@ -5,7 +5,7 @@
 /**
  * @brief Eye-light shader class
  */
-class CShaderEyelight : public CShaderFlat
+class CShaderEyelight final : public CShaderFlat
 {
 public:
 	/**
@@ -15,13 +15,23 @@ public:
 	 * @param color The color of the object
 	 */
 	CShaderEyelight(Vec3f color = RGB(0.5f, 0.5f, 0.5f))
-		: CShaderFlat(color)
+		: CShaderFlat(color, ShaderType::eyelight)
 	{}
 	virtual ~CShaderEyelight(void) = default;
 
 	virtual Vec3f shade(const Ray& ray) const override
 	{
-		return CShaderFlat::shade(ray) * fabs(ray.dir.dot(ray.hit->getNormal(ray)));
+		return shade(ray, ray.hit->getNormal(ray));
+	}
+	/**
+	 * @brief Calculates the color of the hit by the ray \b ray object, with the known normal
+	 * @param ray The ray hitting the primitive
+	 * @param normal The normal of the primitive in the hit point
+	 * @return The color of the hit object
+	 */
+	Vec3f shade(const Ray& ray, const Vec3f& normal) const
+	{
+		return CShaderFlat::shade(ray) * fabs(ray.dir.dot(normal));
 	}
 };
 
@@ -12,14 +12,26 @@ public:
 	 * @brief Constructor
 	 * @details This is a texture-free and light-source-free shader
 	 * @param color The color of the object
+	 * @note In the closed-set shading mode (Ref. ShaderDispatch.h) only the objects of exactly this class are shaded statically;
+	 * the classes derived from CShaderFlat are shaded through the virtual interface, unless they pass their own type tag to the protected constructor
 	 */
-	CShaderFlat(const Vec3f& color) : m_color(color) {}
+	CShaderFlat(const Vec3f& color) : CShaderFlat(color, ShaderType::flat) {}
 
 	virtual Vec3f shade(const Ray& ray = Ray()) const override
 	{
 		return m_color;
 	}
 
+
+protected:
+	/**
+	 * @brief Constructor for the derived shaders
+	 * @param color The color of the object
+	 * @param type The shader type tag
+	 */
+	CShaderFlat(const Vec3f& color, ShaderType type) : IShader(type), m_color(color) {}
+
+
 private:
 	Vec3f m_color;
 };
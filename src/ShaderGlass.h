@@ -0,0 +1,72 @@
+#pragma once
+
+#include "IShader.h"
+#include "ray.h"
+
+/**
+ * @brief Glass shader class
+ * @details The dielectric surface, which reflects and refracts the incoming light. The ratio of the reflected light is given
+ * by the Schlick's approximation of the Fresnel equations; at angles beyond the critical one the light is reflected completely.
+ * The normals of the glass objects must point outside
+ */
+class CShaderGlass : public IShader
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param color The color (transmittance) of the glass
+	 * @param ior The index of refraction of the glass
+	 */
+	CShaderGlass(const Vec3f& color = RGB(1, 1, 1), float ior = 1.5f)
+		: m_color(color)
+		, m_ior(ior)
+	{}
+	virtual ~CShaderGlass(void) = default;
+
+	virtual Vec3f shade(const Ray& ray) const override
+	{
+		return Vec3f(0, 0, 0);
+	}
+
+	virtual size_t scatter(const Ray& ray, std::array<SecondaryRay, 2>& secondary) const override
+	{
+		Vec3f normal = ray.hit->getNormal(ray);
+		float cosI = -normal.dot(ray.dir);
+		float eta = 1.0f / m_ior;					// the ray enters the glass
+		if (cosI < 0) {								// the ray leaves the glass
+			normal = -normal;
+			cosI = -cosI;
+			eta = m_ior;
+		}
+		const Vec3fa hitPoint = ray.org + ray.t * ray.dir;
+
+		secondary[0].ray.org = offsetRayOrigin(hitPoint, normal);
+		secondary[0].ray.dir = normalize(ray.dir + 2 * cosI * normal);
+		secondary[0].ray.t = std::numeric_limits<float>::infinity();
+		secondary[0].ray.hit = nullptr;
+
+		float k = 1 - eta * eta * (1 - cosI * cosI);
+		if (k < 0) {								// total internal reflection
+			secondary[0].weight = Vec3f::all(1);
+			return 1;
+		}
+
+		float r0 = (1 - m_ior) / (1 + m_ior);
+		r0 *= r0;
+		float cosine = eta > 1 ? sqrtf(k) : cosI;	// the angle on the side of the less dense medium
+		float reflectance = r0 + (1 - r0) * powf(1 - cosine, 5);
+		secondary[0].weight = Vec3f::all(reflectance);
+
+		secondary[1].ray.org = offsetRayOrigin(hitPoint, -normal);
+		secondary[1].ray.dir = normalize(eta * ray.dir + (eta * cosI - sqrtf(k)) * normal);
+		secondary[1].ray.t = std::numeric_limits<float>::infinity();
+		secondary[1].ray.hit = nullptr;
+		secondary[1].weight = (1 - reflectance) * m_color;
+		return 2;
+	}
+
+
+private:
+	Vec3f	m_color;	///< The color of the glass
+	float	m_ior;		///< The index of refraction
+};
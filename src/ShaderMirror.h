@@ -0,0 +1,40 @@
+#pragma once
+
+#include "IShader.h"
+#include "ray.h"
+
+/**
+ * @brief Mirror shader class
+ * @details The perfect specular reflector. The color of the surface is the color seen along the reflected ray, filtered by the mirror color
+ */
+class CShaderMirror : public IShader
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param color The color (reflectance) of the mirror
+	 */
+	CShaderMirror(const Vec3f& color = RGB(1, 1, 1)) : m_color(color) {}
+	virtual ~CShaderMirror(void) = default;
+
+	virtual Vec3f shade(const Ray& ray) const override
+	{
+		return Vec3f(0, 0, 0);
+	}
+
+	virtual size_t scatter(const Ray& ray, std::array<SecondaryRay, 2>& secondary) const override
+	{
+		Vec3f normal = ray.hit->getNormal(ray);
+		float cosI = normal.dot(ray.dir);
+		secondary[0].ray.org = offsetRayOrigin(ray.org + ray.t * ray.dir, cosI > 0 ? -normal : normal);
+		secondary[0].ray.dir = normalize(ray.dir - 2 * cosI * normal);
+		secondary[0].ray.t = std::numeric_limits<float>::infinity();
+		secondary[0].ray.hit = nullptr;
+		secondary[0].weight = m_color;
+		return 1;
+	}
+
+
+private:
+	Vec3f m_color;		///< The color of the mirror
+};
@@ -1,8 +1,9 @@
 #pragma once
 
 #include "ShaderFlat.h"
+#include "RenderContext.h"
 
-class CShaderPhong : public CShaderFlat
+class CShaderPhong final : public CShaderFlat
 {
 public:
 	/**
@@ -15,7 +16,7 @@ public:
 	 * @param ke The shininess exponent
 	 */
 	CShaderPhong(CScene& scene, Vec3f color, float ka, float kd, float ks, float ke)
-		: CShaderFlat(color)
+		: CShaderFlat(color, ShaderType::phong)
 		, m_scene(scene)
 		, m_ka(ka)
 		, m_kd(kd)
@@ -26,15 +27,64 @@ public:
 
 	virtual Vec3f shade(const Ray& ray) const override
 	{
-		// get shading normal
-		Vec3f normal = ray.hit->getNormal(ray);
+		return shade(ray, ray.hit->getNormal(ray));
+	}
+
+	virtual Vec3f shadeDeferred(const Ray& ray, std::vector<ShadowRay>& vShadowRays) const override
+	{
+		return shadeDeferred(ray, ray.hit->getNormal(ray), vShadowRays);
+	}
+	/**
+	 * @brief Calculates the color of the hit by the ray \b ray object, with the known normal
+	 * @param ray The ray hitting the primitive
+	 * @param normal The normal of the primitive in the hit point
+	 * @return The color of the hit object
+	 */
+	Vec3f shade(const Ray& ray, const Vec3f& normal) const
+	{
+		Vec3f res = eval(ray, normal, [this](Ray& shadow, const Vec3f& contribution) {
+			return m_scene.occluded(shadow) ? Vec3f(0, 0, 0) : contribution;
+		});
+
+		for (int i = 0; i < 3; i++)
+			if (res.val[i] > 1) res.val[i] = 1;
 
+		return res;
+	}
+	/**
+	 * @brief Calculates the color of the hit by the ray \b ray object with the known normal, deferring the visibility tests
+	 * @param ray The ray hitting the primitive
+	 * @param normal The normal of the primitive in the hit point
+	 * @param[in,out] vShadowRays The container, where the shadow rays are appended to
+	 * @return The visibility-independent part of the color of the hit object
+	 */
+	Vec3f shadeDeferred(const Ray& ray, const Vec3f& normal, std::vector<ShadowRay>& vShadowRays) const
+	{
+		return eval(ray, normal, [&vShadowRays](Ray& shadow, const Vec3f& contribution) {
+			vShadowRays.push_back(ShadowRay{ shadow, contribution, 0 });
+			return Vec3f(0, 0, 0);
+		});
+	}
+
+
+private:
+	/**
+	 * @brief Calculates the color of the hit by the ray \b ray object
+	 * @param ray The ray hitting the primitive
+	 * @param normal The normal of the primitive in the hit point
+	 * @param visible The functor \b Vec3f(Ray& shadow, const Vec3f& contribution), which resolves the visibility of the light source along the \b shadow ray.
+	 * It returns the part of the \b contribution to be added immediately
+	 * @return The color of the hit object (not clamped)
+	 */
+	template <class F>
+	Vec3f eval(const Ray& ray, Vec3fa normal, F visible) const
+	{
 		// turn normal to front
 		if (normal.dot(ray.dir) > 0)
 			normal = -normal;
 
 		// calculate reflection vector
-		Vec3f reflect = normalize(ray.dir - 2 * normal.dot(ray.dir) * normal);
+		const Vec3fa reflect = normalize(ray.dir - 2 * normal.dot(ray.dir) * normal);
 
 		// ambient term
 		Vec3f ambientIntensity(1, 1, 1);
@@ -45,37 +95,68 @@ public:
 
 		// shadow ray (up to now only for the light direction)
 		Ray shadow;
-		shadow.org = ray.org + ray.t * ray.dir;
-
-		// iterate over all light sources
-		for (auto pLight : m_scene.getLights()) {
-			// get direction to light, and intensity
-			std::optional<Vec3f> lightIntensity = pLight->illuminate(shadow);
-			if (lightIntensity) {
-				// diffuse term
-				float cosLightNormal = shadow.dir.dot(normal);
-				if (cosLightNormal > 0) {
-					if (m_scene.occluded(shadow))
-						continue;
-
-					Vec3f diffuseColor = m_kd * color;
-					res += (diffuseColor * cosLightNormal).mul(lightIntensity.value());
-				}
+		shadow.org = offsetRayOrigin(ray.org + ray.t * ray.dir, normal);
 
-				// specular term
-				float cosLightReflect = shadow.dir.dot(reflect);
-				if (cosLightReflect > 0) {
-					Vec3f specularColor = m_ks * RGB(1, 1, 1); // white highlight;
-					res += (specularColor * powf(cosLightReflect, m_ke)).mul(lightIntensity.value());
+		const CLightBVH* pLightBVH = m_scene.getLightBVH();
+		if (pLightBVH) {
+			// sample a few light sources with probabilities proportional to their estimated contributions
+			// the estimate is unbiased up to the final clamping of the color
+			CRandom& rng = CRenderContext::get().getRNG();
+			const size_t nSamples = m_scene.getNumLightSamples();
+			for (size_t s = 0; s < nSamples; s++) {
+				float u = MIN((s + rng.uniform()) / nSamples, 1.0f - std::numeric_limits<float>::epsilon());	// stratified sample
+				auto [pLight, pdf] = pLightBVH->sample(shadow.org, u);
+				if (pLight && pdf > 0) {
+					auto [contribution, occludable] = illuminate(*pLight, shadow, normal, reflect, color);
+					contribution = contribution / (pdf * nSamples);
+					res += occludable ? visible(shadow, contribution) : contribution;
 				}
 			}
 		}
-
-		for (int i = 0; i < 3; i++)
-			if (res.val[i] > 1) res.val[i] = 1;
+		else
+			// iterate over all light sources
+			for (auto& pLight : m_scene.getLights()) {
+				auto [contribution, occludable] = illuminate(*pLight, shadow, normal, reflect, color);
+				res += occludable ? visible(shadow, contribution) : contribution;
+			}
 
 		return res;
 	}
+	/**
+	 * @brief Calculates the diffuse and specular contribution of a single light source
+	 * @param light The light source
+	 * @param[in,out] shadow The shadow ray, originating at the shading point
+	 * @param normal The shading normal, turned to front
+	 * @param reflect The reflection vector
+	 * @param color The color of the object
+	 * @return The pair with the contribution of the light source \b light and the flag indicating
+	 * whether the contribution is to be added only if the light source is not occluded along the \b shadow ray
+	 */
+	std::pair<Vec3f, bool> illuminate(ILight& light, Ray& shadow, const Vec3fa& normal, const Vec3fa& reflect, const Vec3f& color) const
+	{
+		Vec3f res(0, 0, 0);
+		bool occludable = false;
+
+		// get direction to light, and intensity
+		std::optional<Vec3f> lightIntensity = light.illuminate(shadow);
+		if (lightIntensity) {
+			// diffuse term
+			float cosLightNormal = shadow.dir.dot(normal);
+			if (cosLightNormal > 0) {
+				occludable = true;
+				Vec3f diffuseColor = m_kd * color;
+				res += (diffuseColor * cosLightNormal).mul(lightIntensity.value());
+			}
+
+			// specular term
+			float cosLightReflect = shadow.dir.dot(reflect);
+			if (cosLightReflect > 0) {
+				Vec3f specularColor = m_ks * RGB(1, 1, 1); // white highlight;
+				res += (specularColor * powf(cosLightReflect, m_ke)).mul(lightIntensity.value());
+			}
+		}
+		return std::make_pair(res, occludable);
+	}
 
 
 private:
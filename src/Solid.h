@@ -3,6 +3,9 @@
 #pragma once
 
 #include "PrimTriangle.h"
+#include "PerfCounters.h"
+#include "Tracer.h"
+#include "InputStream.h"
 #include <fstream> 
 
 class CSolid {
@@ -15,12 +18,36 @@ public:
 	 */
 	CSolid(ptr_shader_t pShader, const std::string& fileName)
 	{
-		std::ifstream file(fileName);
+		std::vector<Vec3f> vVertexes;
+		std::vector<Vec3i> vFaces;
+		parse(fileName, vVertexes, vFaces);
+		for (const Vec3i& face : vFaces)
+			add(std::make_shared<CPrimTriangle>(pShader, vVertexes[face.val[0]], vVertexes[face.val[1]], vVertexes[face.val[2]]));
+	}
+	CSolid(const CSolid&) = delete;
+	virtual ~CSolid(void) = default;
+	CSolid& operator=(const CSolid&) = delete;
+
+	const std::vector<ptr_prim_t>&  getPrims(void) const { return m_vpPrims; }
+
+	/**
+	 * @brief Parses an .obj file into an indexed triangle mesh
+	 * @details The file may be gzip or zstd compressed (Ref. CInputStream); it is decompressed in a separate thread while being parsed
+	 * @param[in] fileName The full path to the .obj file
+	 * @param[out] vVertexes The vertex positions
+	 * @param[out] vFaces The triangles as triples of the vertex indices
+	 * @retval true If the file was parsed
+	 * @retval false If the file can not be opened
+	 */
+	static bool parse(const std::string& fileName, std::vector<Vec3f>& vVertexes, std::vector<Vec3i>& vFaces)
+	{
+		PERF_SCOPE(PerfStage::load);
+		TRACE_SCOPE("OBJ parse");
+		CInputStream file(fileName);
 
 		if (file.is_open()) {
 			std::cout << "Parsing OBJFile : " << fileName << std::endl;
 
-			std::vector<Vec3f> vVertexes;
 			std::vector<Vec3f> vNormals;
 			std::vector<Vec2f> vTextures;
 
@@ -29,57 +56,52 @@ public:
 			int nFaces = 0;
 			for (;;) {
 				if (!getline(file, line)) break;
-				std::stringstream ss(line);
-				getline(ss, line, ' ');
-				if (line == "v") {
+				// the key is the first word; the values are parsed in place, which is faster than a string stream per line
+				const size_t keyLength = MIN(line.find(' '), line.size());
+				const std::string key = line.substr(0, keyLength);
+				const char* pValues = line.c_str() + keyLength;
+				if (key == "v") {
 					Vec3f v;
-					for (int i = 0; i < 3; i++) ss >> v.val[i];
+					for (int i = 0; i < 3; i++) v.val[i] = parseFloat(pValues);
 					// std::cout << "Vertex: " << v << std::endl;
 					vVertexes.push_back(8 * v);
 				}
-				else if (line == "vt") {
+				else if (key == "vt") {
 					Vec2f vt;
-					for (int i = 0; i < 2; i++) ss >> vt.val[i];
+					for (int i = 0; i < 2; i++) vt.val[i] = parseFloat(pValues);
 					vTextures.push_back(vt);
 				}
-				else if (line == "vn") {
+				else if (key == "vn") {
 					Vec3f vn;
-					for (int i = 0; i < 3; i++) ss >> vn.val[i];
+					for (int i = 0; i < 3; i++) vn.val[i] = parseFloat(pValues);
 					vNormals.push_back(vn);
 				}
-				else if (line == "f") {
+				else if (key == "f") {
 					nFaces++;
 					//if (nFaces > 10000) continue;
-					int v, n, t;
-					Vec3i V, N, T;
+					Vec3i V;
 					for (int i = 0; i < 3; i++) {
-						getline(ss, line, ' ');
-						sscanf(line.c_str(), "%d/%d/%d", &v, &t, &n);
-						V.val[i] = v - 1;
-						T.val[i] = t - 1;
-						N.val[i] = n - 1;
+						char* pEnd;
+						V.val[i] = static_cast<int>(strtol(pValues, &pEnd, 10)) - 1;
+						pValues = pEnd + strcspn(pEnd, " ");	// the texture and normal indices are not used
 					}
 					//std::cout << "Face: " << V << std::endl;
-					//std::cout << "Normal: " << N << std::endl;
-					add(std::make_shared<CPrimTriangle>(pShader, vVertexes[V.val[0]], vVertexes[V.val[1]], vVertexes[V.val[2]]));
+					vFaces.push_back(V);
 				}
-				else if (line == "#") {}
+				else if (key == "#") {}
 				else {
-					std::cout << "Unknown key [" << line << "] met in the OBJ file" << std::endl;
+					std::cout << "Unknown key [" << key << "] met in the OBJ file" << std::endl;
 				}
 			}
 
 			file.close();
 			std::cout << "Finished Parsing" << std::endl;
+			return true;
 		}
 		else
 			std::cout << "ERROR: Can't open OBJFile " << fileName << std::endl;
+		return false;
 	}
-	CSolid(const CSolid&) = delete;
-	virtual ~CSolid(void) = default;
-	CSolid& operator=(const CSolid&) = delete;
-
-	const std::vector<ptr_prim_t>&  getPrims(void) const { return m_vpPrims; }
 
 
 protected:
@@ -90,6 +112,17 @@ protected:
 	}
 
 
+private:
+	// Parses the next number of the line and advances \b pStr past it
+	static float parseFloat(const char*& pStr)
+	{
+		char* pEnd;
+		const float res = strtof(pStr, &pEnd);
+		pStr = pEnd;
+		return res;
+	}
+
+
 private:
 	std::vector<ptr_prim_t>	m_vpPrims;
 };
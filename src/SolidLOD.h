@@ -0,0 +1,403 @@
+// Level-of-Detail Solid class
+#pragma once
+
+#include "Solid.h"
+#include "PrimMesh.h"
+#include "ICamera.h"
+#include <filesystem>
+#include <queue>
+
+// ================================ Level-of-Detail Solid Class ================================
+/**
+ * @brief Solid with several levels of detail
+ * @details The mesh is loaded from an .obj file as the finest level. Every next level is simplified from the previous one to a quarter of
+ * its triangles by the edge collapses, ordered by the quadric error metric (Ref. M. Garland, P. Heckbert: Surface Simplification Using
+ * Quadric Error Metrics, SIGGRAPH 1997). The levels are cached on disk next to the .obj file and are rebuilt only if the file changes.
+ * A level is chosen per camera from the projected size of the solid (Ref. selectLevel()) and is added to the scene as one
+ * primitive with its own acceleration structure (Ref. CPrimMesh). Only the indexed meshes of the levels stay resident
+ */
+class CSolidLOD
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @details Reads the levels from the cache or builds and caches them
+	 * @param pShader Pointer to the shader to be used with the solid
+	 * @param fileName The full path to the .obj file
+	 * @param maxLevels The maximum number of levels, including the finest one
+	 */
+	CSolidLOD(ptr_shader_t pShader, const std::string& fileName, size_t maxLevels = 6)
+		: m_pShader(pShader)
+	{
+		const std::string cacheFileName = fileName + ".lod";
+		if (!read(cacheFileName, fileName, maxLevels)) {
+			m_vLevels.clear();
+			Level level;
+			if (!CSolid::parse(fileName, level.vVertexes, level.vFaces)) return;
+			m_vLevels.push_back(std::move(level));
+			while (m_vLevels.size() < maxLevels && m_vLevels.back().vFaces.size() / 4 >= m_minFaces) {
+				Level next = simplify(m_vLevels.back(), m_vLevels.back().vFaces.size() / 4);
+				if (next.vFaces.size() >= m_vLevels.back().vFaces.size()) break;		// no collapse is possible anymore
+				m_vLevels.push_back(std::move(next));
+			}
+			if (!write(cacheFileName, fileName, maxLevels))
+				std::cout << "WARNING: Can't write the LOD cache " << cacheFileName << std::endl;
+		}
+		for (const Vec3f& v : m_vLevels.front().vVertexes)
+			m_box.extend(v);
+		for (size_t l = 0; l < m_vLevels.size(); l++)
+			printf("LOD level %zu: %zu triangles, error %g\n", l, m_vLevels[l].vFaces.size(), m_vLevels[l].error);
+	}
+	CSolidLOD(const CSolidLOD&) = delete;
+	~CSolidLOD(void) = default;
+	const CSolidLOD& operator=(const CSolidLOD&) = delete;
+
+	/**
+	 * @brief Chooses the level of detail for the camera \b camera
+	 * @details The geometric error of a level is the distance, by which its surface may deviate from the finest one. The coarsest level,
+	 * whose error projected on the screen does not exceed \b tolerance pixels, is chosen
+	 * @param camera The camera
+	 * @param tolerance The maximal screen-space error in pixels
+	 * @returns The index of the level
+	 */
+	size_t selectLevel(const ICamera& camera, float tolerance = 0.5f) const
+	{
+		if (m_vLevels.empty()) return 0;
+		const float size = camera.getProjectedSize(m_box);
+		const float pixelsPerUnit = size / norm(m_box.getMaxPoint() - m_box.getMinPoint());
+		size_t res = 0;
+		while (res + 1 < m_vLevels.size() && m_vLevels[res + 1].error * pixelsPerUnit <= tolerance) res++;
+		return res;
+	}
+	/**
+	 * @brief Creates the primitive of a level
+	 * @param level The index of the level
+	 * @returns The triangle mesh of the level with its own acceleration structure, or nullptr if the solid was not loaded
+	 */
+	std::shared_ptr<CPrimMesh> getPrim(size_t level) const
+	{
+		if (m_vLevels.empty()) return nullptr;
+		const Level& lv = m_vLevels[MIN(level, m_vLevels.size() - 1)];
+		return std::make_shared<CPrimMesh>(m_pShader, lv.vVertexes, lv.vFaces);
+	}
+	/**
+	 * @brief Returns the number of levels
+	 * @returns The number of levels of detail
+	 */
+	size_t getNumLevels(void) const { return m_vLevels.size(); }
+
+
+private:
+	/// Level of detail
+	struct Level
+	{
+		std::vector<Vec3f>	vVertexes;	///< The vertex positions
+		std::vector<Vec3i>	vFaces;		///< The triangles as triples of the vertex indices
+		float				error = 0;	///< The maximal distance from the finest level
+	};
+
+	/// Symmetric 4x4 matrix of the quadric error metric: the sum of the squared distances to a set of planes
+	struct Quadric
+	{
+		std::array<double, 10>	q = {};		///< The upper triangle of the matrix
+
+		Quadric(void) = default;
+		/**
+		 * @brief Constructor
+		 * @param n The normal of the plane
+		 * @param d The offset of the plane: n.p + d = 0
+		 * @param w The weight of the plane
+		 */
+		Quadric(const Vec3d& n, double d, double w = 1)
+			: q{ w * n[0] * n[0], w * n[0] * n[1], w * n[0] * n[2], w * n[0] * d, w * n[1] * n[1], w * n[1] * n[2], w * n[1] * d, w * n[2] * n[2], w * n[2] * d, w * d * d }
+		{}
+		Quadric& operator+=(const Quadric& other) { for (size_t i = 0; i < q.size(); i++) q[i] += other.q[i]; return *this; }
+		Quadric operator+(const Quadric& other) const { return Quadric(*this) += other; }
+		// Returns the sum of the squared distances from point p
+		double evaluate(const Vec3d& p) const
+		{
+			const double x = p[0], y = p[1], z = p[2];
+			return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+				+ q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y + q[7] * z * z + 2 * q[8] * z + q[9];
+		}
+		// Finds the point of the minimal error. Returns false if the matrix is singular
+		bool minimize(Vec3d& p) const
+		{
+			// p = -A^-1 b, where A is the upper-left 3x3 block and b is the last column; the inverse is the adjugate over the determinant
+			const double a00 = q[4] * q[7] - q[5] * q[5];
+			const double a01 = q[2] * q[5] - q[1] * q[7];
+			const double a02 = q[1] * q[5] - q[2] * q[4];
+			const double a11 = q[0] * q[7] - q[2] * q[2];
+			const double a12 = q[1] * q[2] - q[0] * q[5];
+			const double a22 = q[0] * q[4] - q[1] * q[1];
+			const double det = q[0] * a00 + q[1] * a01 + q[2] * a02;
+			if (det == 0) return false;
+			p[0] = -(a00 * q[3] + a01 * q[6] + a02 * q[8]) / det;
+			p[1] = -(a01 * q[3] + a11 * q[6] + a12 * q[8]) / det;
+			p[2] = -(a02 * q[3] + a12 * q[6] + a22 * q[8]) / det;
+			return true;
+		}
+	};
+
+	/// Candidate edge collapse
+	struct Collapse
+	{
+		double	cost;		///< The quadric error of the new vertex
+		int		u, v;		///< The vertices of the edge; v is merged into u
+		int		uStamp;		///< The version of vertex u, for which the collapse is valid
+		int		vStamp;		///< The version of vertex v, for which the collapse is valid
+		Vec3d	pos;		///< The position of the new vertex
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	/**
+	 * @brief Simplifies the mesh by the edge collapses with the smallest quadric error
+	 * @details Every vertex accumulates the quadric of the planes of its faces; the boundary edges add the planes, perpendicular to their faces.
+	 * The collapses are taken from a priority queue; the collapses of the changed vertices are invalidated with the version stamps.
+	 * A collapse is rejected if it flips a face
+	 * @param src The mesh to be simplified
+	 * @param targetFaces The number of triangles, at which the simplification stops
+	 * @returns The simplified mesh. Its error is the error of \b src plus the largest distance of a new vertex from the planes of \b src
+	 */
+	static Level simplify(const Level& src, size_t targetFaces)
+	{
+		TRACE_SCOPE_ARG("LOD simplification", "triangles", static_cast<int64>(src.vFaces.size()));
+		const double boundaryWeight = 100;
+		const size_t nVertexes = src.vVertexes.size();
+		std::vector<Vec3d> vPos(nVertexes);
+		for (size_t i = 0; i < nVertexes; i++) vPos[i] = static_cast<Vec3d>(src.vVertexes[i]);
+		std::vector<Vec3i> vFaces = src.vFaces;
+		std::vector<byte> vFaceAlive(vFaces.size(), 1);
+		std::vector<std::vector<int>> vvVertexFaces(nVertexes);
+		std::vector<Quadric> vQuadrics(nVertexes);
+		std::vector<int> vStamps(nVertexes, 0);
+		std::vector<byte> vAlive(nVertexes, 1);
+
+		// The planes of the faces and the edges
+		std::vector<std::pair<std::pair<int, int>, int>> vEdges;		// (min vertex, max vertex), face
+		vEdges.reserve(3 * vFaces.size());
+		for (size_t f = 0; f < vFaces.size(); f++) {
+			const Vec3i& face = vFaces[f];
+			for (int i = 0; i < 3; i++) {
+				vvVertexFaces[face[i]].push_back(static_cast<int>(f));
+				vEdges.emplace_back(std::make_pair(MIN(face[i], face[(i + 1) % 3]), MAX(face[i], face[(i + 1) % 3])), static_cast<int>(f));
+			}
+			Vec3d n = (vPos[face[1]] - vPos[face[0]]).cross(vPos[face[2]] - vPos[face[0]]);
+			const double len = cv::norm(n);
+			if (len == 0) continue;
+			n *= 1 / len;
+			const Quadric quadric(n, -n.dot(vPos[face[0]]));
+			for (int i = 0; i < 3; i++) vQuadrics[face[i]] += quadric;
+		}
+		std::sort(vEdges.begin(), vEdges.end());
+		for (size_t i = 0; i < vEdges.size(); ) {
+			size_t j = i;
+			while (j < vEdges.size() && vEdges[j].first == vEdges[i].first) j++;
+			if (j - i == 1) {
+				// the boundary edge is kept in place by the plane through the edge, perpendicular to its face
+				const int a = vEdges[i].first.first;
+				const int b = vEdges[i].first.second;
+				const Vec3i& face = vFaces[vEdges[i].second];
+				const Vec3d n = (vPos[face[1]] - vPos[face[0]]).cross(vPos[face[2]] - vPos[face[0]]);
+				Vec3d m = (vPos[b] - vPos[a]).cross(n);
+				const double len = cv::norm(m);
+				if (len > 0) {
+					m *= 1 / len;
+					const Quadric quadric(m, -m.dot(vPos[a]), boundaryWeight);
+					vQuadrics[a] += quadric;
+					vQuadrics[b] += quadric;
+				}
+			}
+			i = j;
+		}
+
+		// The candidate collapses
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+		auto push = [&](int u, int v) {
+			const Quadric quadric = vQuadrics[u] + vQuadrics[v];
+			// the optimal position is taken only near the edge; otherwise the best of the end points and of the midpoint
+			Vec3d pos;
+			const double len = cv::norm(vPos[u] - vPos[v]);
+			if (!quadric.minimize(pos) || cv::norm(pos - 0.5 * (vPos[u] + vPos[v])) > len) {
+				pos = 0.5 * (vPos[u] + vPos[v]);
+				for (const Vec3d& p : { vPos[u], vPos[v] })
+					if (quadric.evaluate(p) < quadric.evaluate(pos)) pos = p;
+			}
+			queue.push(Collapse{ MAX(0.0, quadric.evaluate(pos)), u, v, vStamps[u], vStamps[v], pos });
+		};
+		for (size_t i = 0; i < vEdges.size(); i++)
+			if (i == 0 || vEdges[i].first != vEdges[i - 1].first)
+				push(vEdges[i].first.first, vEdges[i].first.second);
+
+		// Checks whether moving vertex a of the faces, which do not contain vertex b, to position pos flips any of them
+		auto flips = [&](int a, int b, const Vec3d& pos) {
+			for (int f : vvVertexFaces[a]) {
+				const Vec3i& face = vFaces[f];
+				if (!vFaceAlive[f] || face[0] == b || face[1] == b || face[2] == b) continue;
+				int i = face[0] == a ? 0 : face[1] == a ? 1 : 2;
+				const Vec3d& p1 = vPos[face[(i + 1) % 3]];
+				const Vec3d& p2 = vPos[face[(i + 2) % 3]];
+				const Vec3d n0 = (p1 - vPos[a]).cross(p2 - vPos[a]);
+				const Vec3d n1 = (p1 - pos).cross(p2 - pos);
+				const double len0 = cv::norm(n0);
+				if (len0 > 0 && n0.dot(n1) <= 0.2 * len0 * cv::norm(n1)) return true;
+			}
+			return false;
+		};
+
+		// The collapses
+		size_t nFaces = vFaces.size();
+		double maxCost = 0;
+		while (nFaces > targetFaces && !queue.empty()) {
+			const Collapse c = queue.top();
+			queue.pop();
+			if (!vAlive[c.u] || !vAlive[c.v] || vStamps[c.u] != c.uStamp || vStamps[c.v] != c.vStamp) continue;		// outdated
+			if (flips(c.u, c.v, c.pos) || flips(c.v, c.u, c.pos)) continue;
+
+			maxCost = MAX(maxCost, c.cost);
+			vPos[c.u] = c.pos;
+			vQuadrics[c.u] += vQuadrics[c.v];
+			vAlive[c.v] = 0;
+			vStamps[c.u]++;
+			for (int f : vvVertexFaces[c.v]) {
+				if (!vFaceAlive[f]) continue;
+				Vec3i& face = vFaces[f];
+				if (face[0] == c.u || face[1] == c.u || face[2] == c.u) {
+					vFaceAlive[f] = 0;		// the face degenerates to the edge
+					nFaces--;
+				}
+				else {
+					for (int i = 0; i < 3; i++)
+						if (face[i] == c.v) face[i] = c.u;
+					vvVertexFaces[c.u].push_back(f);
+				}
+			}
+			vvVertexFaces[c.v] = std::vector<int>();
+
+			// the collapses of the edges, incident to the new vertex
+			std::vector<int>& vUFaces = vvVertexFaces[c.u];
+			vUFaces.erase(std::remove_if(vUFaces.begin(), vUFaces.end(), [&](int f) { return !vFaceAlive[f]; }), vUFaces.end());
+			std::vector<int> vNeighbours;
+			for (int f : vUFaces)
+				for (int i = 0; i < 3; i++)
+					if (vFaces[f][i] != c.u) vNeighbours.push_back(vFaces[f][i]);
+			std::sort(vNeighbours.begin(), vNeighbours.end());
+			vNeighbours.erase(std::unique(vNeighbours.begin(), vNeighbours.end()), vNeighbours.end());
+			for (int w : vNeighbours)
+				push(c.u, w);
+		}
+
+		// The remaining vertices and faces are compacted
+		Level res;
+		res.error = src.error + static_cast<float>(sqrt(maxCost));
+		std::vector<int> vIdx(nVertexes, -1);
+		for (size_t f = 0; f < vFaces.size(); f++) {
+			if (!vFaceAlive[f]) continue;
+			Vec3i face;
+			for (int i = 0; i < 3; i++) {
+				int& idx = vIdx[vFaces[f][i]];
+				if (idx < 0) {
+					idx = static_cast<int>(res.vVertexes.size());
+					res.vVertexes.push_back(static_cast<Vec3f>(vPos[vFaces[f][i]]));
+				}
+				face[i] = idx;
+			}
+			res.vFaces.push_back(face);
+		}
+		return res;
+	}
+
+	/**
+	 * @brief Reads the levels from the cache file
+	 * @details The cache is valid only if it was written for the same size and modification time of the .obj file and for the same number of levels
+	 * @param cacheFileName The full path to the cache file
+	 * @param fileName The full path to the .obj file
+	 * @param maxLevels The maximum number of levels
+	 * @retval true If the levels were read
+	 * @retval false If the cache is missing, outdated or corrupted
+	 */
+	bool read(const std::string& cacheFileName, const std::string& fileName, size_t maxLevels)
+	{
+		std::ifstream file(cacheFileName, std::ios::binary);
+		if (!file.is_open()) return false;
+		Header header;
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != m_magic || header.version != m_version) return false;
+		const Header source = getHeader(fileName, maxLevels);
+		if (header.fileSize != source.fileSize || header.fileTime != source.fileTime || header.maxLevels != source.maxLevels || header.nLevels == 0) return false;
+
+		TRACE_SCOPE("LOD cache read");
+		std::cout << "Reading LOD cache : " << cacheFileName << std::endl;
+		m_vLevels.resize(header.nLevels);
+		for (Level& level : m_vLevels) {
+			dword size[2] = { 0, 0 };
+			file.read(reinterpret_cast<char*>(&level.error), sizeof(level.error));
+			file.read(reinterpret_cast<char*>(size), sizeof(size));
+			if (!file) return false;
+			level.vVertexes.resize(size[0]);
+			level.vFaces.resize(size[1]);
+			file.read(reinterpret_cast<char*>(level.vVertexes.data()), level.vVertexes.size() * sizeof(Vec3f));
+			file.read(reinterpret_cast<char*>(level.vFaces.data()), level.vFaces.size() * sizeof(Vec3i));
+			if (!file) return false;
+			for (const Vec3i& face : level.vFaces)
+				for (int i = 0; i < 3; i++)
+					if (face[i] < 0 || face[i] >= static_cast<int>(size[0])) return false;
+		}
+		return true;
+	}
+	/**
+	 * @brief Writes the levels into the cache file
+	 * @param cacheFileName The full path to the cache file
+	 * @param fileName The full path to the .obj file
+	 * @param maxLevels The maximum number of levels
+	 * @retval true If the levels were written
+	 * @retval false Otherwise
+	 */
+	bool write(const std::string& cacheFileName, const std::string& fileName, size_t maxLevels) const
+	{
+		std::ofstream file(cacheFileName, std::ios::binary);
+		if (!file.is_open()) return false;
+		Header header = getHeader(fileName, maxLevels);
+		header.nLevels = static_cast<dword>(m_vLevels.size());
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (const Level& level : m_vLevels) {
+			const dword size[2] = { static_cast<dword>(level.vVertexes.size()), static_cast<dword>(level.vFaces.size()) };
+			file.write(reinterpret_cast<const char*>(&level.error), sizeof(level.error));
+			file.write(reinterpret_cast<const char*>(size), sizeof(size));
+			file.write(reinterpret_cast<const char*>(level.vVertexes.data()), level.vVertexes.size() * sizeof(Vec3f));
+			file.write(reinterpret_cast<const char*>(level.vFaces.data()), level.vFaces.size() * sizeof(Vec3i));
+		}
+		return static_cast<bool>(file);
+	}
+
+	/// Header of the cache file
+	struct Header
+	{
+		dword	magic;			///< The file signature
+		dword	version;		///< The format version
+		qword	fileSize;		///< The size of the .obj file
+		int64	fileTime;		///< The modification time of the .obj file
+		dword	maxLevels;		///< The maximum number of levels
+		dword	nLevels;		///< The number of levels in the file
+	};
+
+	// Returns the header, identifying the .obj file
+	static Header getHeader(const std::string& fileName, size_t maxLevels)
+	{
+		std::error_code ec;
+		Header res = { m_magic, m_version, 0, 0, static_cast<dword>(maxLevels), 0 };
+		res.fileSize = static_cast<qword>(std::filesystem::file_size(fileName, ec));
+		res.fileTime = static_cast<int64>(std::filesystem::last_write_time(fileName, ec).time_since_epoch().count());
+		return res;
+	}
+
+
+private:
+	static constexpr dword	m_magic = 0x43444F4C;	///< The signature of the cache file: "LODC"
+	static constexpr dword	m_version = 1;			///< The version of the cache file format
+	static constexpr size_t	m_minFaces = 32;		///< The minimal number of triangles of the coarsest level
+
+	ptr_shader_t			m_pShader;				///< The shader of the solid
+	std::vector<Level>		m_vLevels;				///< The levels from the finest to the coarsest one
+	CBoundingBox			m_box;					///< The bounding box of the finest level
+};
@@ -0,0 +1,198 @@
+// Timeline Tracer class
+#pragma once
+
+#include "types.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+
+// ================================ Tracer Class ================================
+/**
+ * @brief Timeline tracer class
+ * @details Records the nested time spans (Ref. CTraceSpan) of all the threads and exports them in the Chrome trace event format,
+ * which may be opened with \a chrome://tracing or \a ui.perfetto.dev. Every thread appends its spans to its own buffer,
+ * thus recording needs neither locks nor atomic read-modify-write operations. When tracing is disabled, a span costs one relaxed atomic load.
+ * @note The spans are compiled in only if ENABLE_TRACING is defined. Otherwise the TRACE_SCOPE() macros expand to nothing
+ */
+class CTracer
+{
+public:
+	/// Completed time span
+	struct Span
+	{
+		const char*		name;		///< The name of the span (a string literal)
+		const char*		argName;	///< The name of the argument or nullptr
+		int64			arg;		///< The value of the argument
+		int64			begin;		///< The begin time in nanoseconds
+		int64			end;		///< The end time in nanoseconds
+	};
+
+	/**
+	 * @brief Enables or disables recording of the spans
+	 * @param enable The flag
+	 */
+	static void enable(bool enable = true) { m_enabled.store(enable, std::memory_order_relaxed); }
+	/**
+	 * @brief Checks whether the spans are being recorded
+	 * @retval true If the tracing is enabled
+	 * @retval false Otherwise
+	 */
+	static bool isEnabled(void) { return m_enabled.load(std::memory_order_relaxed); }
+	/**
+	 * @brief Returns the current time
+	 * @returns The time in nanoseconds since an arbitrary epoch
+	 */
+	static int64 now(void) { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+	/**
+	 * @brief Adds a completed span to the buffer of the calling thread
+	 * @param span The span
+	 */
+	static void record(const Span& span) { getBuffer().vSpans.push_back(span); }
+	/**
+	 * @brief Writes the recorded spans of all the threads to a Chrome trace JSON file
+	 * @note The recording threads must be idle, e.g. the function may be called after rendering
+	 * @param fileName The full path to the trace file
+	 * @retval true If the trace was written successfully
+	 * @retval false Otherwise
+	 */
+	static bool write(const std::string& fileName)
+	{
+		std::ofstream file(fileName);
+		file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		int64 epoch = std::numeric_limits<int64>::max();
+		for (const auto& pBuffer : m_vpBuffers)
+			for (const Span& span : pBuffer->vSpans) epoch = MIN(epoch, span.begin);
+
+		bool first = true;
+		for (const auto& pBuffer : m_vpBuffers) {
+			file << (first ? "" : ",") << format("\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"Thread %zu\"}}",
+				pBuffer->thread, pBuffer->thread);
+			first = false;
+			for (const Span& span : pBuffer->vSpans) {
+				file << format(",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f",
+					span.name, pBuffer->thread, (span.begin - epoch) / 1000.0, (span.end - span.begin) / 1000.0);
+				if (span.argName) file << format(", \"args\": {\"%s\": %lld}", span.argName, static_cast<long long>(span.arg));
+				file << "}";
+			}
+		}
+		file << "\n]}\n";
+		return static_cast<bool>(file);
+	}
+	/**
+	 * @brief Discards the recorded spans of all the threads
+	 * @note The recording threads must be idle
+	 */
+	static void clear(void)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& pBuffer : m_vpBuffers) pBuffer->vSpans.clear();
+	}
+
+
+private:
+	/// Span buffer of a thread. The buffers outlive the threads, thus they are kept by the registry
+	struct Buffer
+	{
+		size_t				thread;		///< The index of the thread in order of the first recorded span
+		std::vector<Span>	vSpans;		///< The recorded spans
+	};
+
+	static Buffer& getBuffer(void)
+	{
+		static thread_local std::shared_ptr<Buffer> pBuffer;
+		if (!pBuffer) {
+			pBuffer = std::make_shared<Buffer>();
+			pBuffer->vSpans.reserve(4096);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			pBuffer->thread = m_vpBuffers.size();
+			m_vpBuffers.push_back(pBuffer);
+		}
+		return *pBuffer;
+	}
+
+
+private:
+	static inline std::atomic<bool>						m_enabled{ false };		///< The recording flag
+	static inline std::mutex							m_mutex;				///< Guards the registry
+	static inline std::vector<std::shared_ptr<Buffer>>	m_vpBuffers;			///< The registry of the span buffers of all the threads
+};
+
+// ================================ Trace Span Class ================================
+/**
+ * @brief Scoped time span class
+ * @details Records the time between its construction and its destruction as a span of the calling thread, if the tracing is enabled.
+ * Use the TRACE_SCOPE() and TRACE_SCOPE_ARG() macros, which compile to nothing in the builds without tracing
+ */
+class CTraceSpan
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param name The name of the span. It must be a string literal or otherwise outlive the tracer. If nullptr, the span is not recorded
+	 * @param argName The name of the argument or nullptr
+	 * @param arg The value of the argument
+	 */
+	CTraceSpan(const char* name, const char* argName = nullptr, int64 arg = 0)
+	{
+		if (!CTracer::isEnabled() || !name) return;
+		m_span = CTracer::Span{ name, argName, arg, CTracer::now(), 0 };
+		m_active = true;
+	}
+	CTraceSpan(const CTraceSpan&) = delete;
+	~CTraceSpan(void)
+	{
+		if (!m_active) return;
+		m_span.end = CTracer::now();
+		CTracer::record(m_span);
+	}
+	const CTraceSpan& operator=(const CTraceSpan&) = delete;
+
+
+private:
+	CTracer::Span	m_span;				///< The span being recorded
+	bool			m_active = false;	///< The flag indicating whether the span is being recorded
+};
+
+// ================================ Trace File Class ================================
+/**
+ * @brief Scoped trace file class
+ * @details Enables the tracing on construction and writes the recorded spans to the trace file on destruction (Ref. CTracer::write()),
+ * thus the trace is written on every exit path of the enclosing scope
+ */
+class CTraceFile
+{
+public:
+	/**
+	 * @brief Constructor
+	 * @param fileName The full path to the trace file. If empty, the tracing is not enabled and no file is written
+	 */
+	CTraceFile(const std::string& fileName) : m_fileName(fileName)
+	{
+		if (!m_fileName.empty()) CTracer::enable();
+	}
+	CTraceFile(const CTraceFile&) = delete;
+	~CTraceFile(void)
+	{
+		if (m_fileName.empty()) return;
+		if (CTracer::write(m_fileName)) printf("Trace is written to %s\n", m_fileName.c_str());
+		else printf("ERROR: Can't write the trace %s\n", m_fileName.c_str());
+	}
+	const CTraceFile& operator=(const CTraceFile&) = delete;
+
+
+private:
+	const std::string	m_fileName;		///< The full path to the trace file
+};
+
+#ifdef ENABLE_TRACING
+/// Traces the rest of the enclosing block as a span named \b name (Ref. CTraceSpan)
+#define TRACE_SCOPE(name) CTraceSpan traceSpan(name)
+/// Traces the rest of the enclosing block as a span named \b name with the integer argument \b argName = \b arg (Ref. CTraceSpan)
+#define TRACE_SCOPE_ARG(name, argName, arg) CTraceSpan traceSpan(name, argName, arg)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_SCOPE_ARG(name, argName, arg)
+#endif
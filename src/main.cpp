@@ -6,22 +6,31 @@
 #include "PrimPlane.h"
 #include "PrimTriangle.h"
 #include "Solid.h"
+#include "SolidLOD.h"
 
 #include "ShaderFlat.h"
 #include "ShaderEyelight.h"
 #include "ShaderPhong.h"
+#include "ShaderMirror.h"
+#include "ShaderGlass.h"
 
 #include "LightOmni.h"
+#include "RendererImmediate.h"
+#include "RendererWavefront.h"
+#include "RenderFarm.h"
+#include "RendererOutOfCore.h"
+#include "RendererReprojection.h"
+#include "RenderServer.h"
+#include "PerfCounters.h"
+#include "Tracer.h"
 #include "timer.h"
 
-Mat RenderFrame(void)
+// Camera resolution
+const Size resolution(800, 600);
+
+// Builds the torus knot scene
+void BuildScene(CScene& scene)
 {
-	// Camera resolution
-	const Size resolution(800, 600);
-	
-	// Define a scene
-	CScene scene;
-	
 	// Add camera to scene
 	scene.add(std::make_shared<CCameraPerspective>(resolution, Vec3f(0, 3.5f, -13), Vec3f(0, 0, 1), Vec3f(0, 1, 0), 60));
 
@@ -38,7 +47,7 @@ Mat RenderFrame(void)
 	scene.add(solid);
 
 	// Build BSPTree
-	scene.buildAccelStructure(20, 3);
+	scene.buildAccelStructure();
 	
 	Vec3f pointLightIntensity(3, 3, 3);
 	Vec3f lightPosition2(-3, 5, 4);
@@ -46,27 +55,364 @@ Mat RenderFrame(void)
 	
 	scene.add(std::make_shared<CLightOmni>(pointLightIntensity, lightPosition2));
 	scene.add(std::make_shared<CLightOmni>(pointLightIntensity, lightPosition3));
+}
 
-	Mat img(resolution, CV_32FC3);							// image array
-	Ray ray;                                          		// primary ray
+Mat RenderFrame(bool wavefront = false, bool calibrate = false)
+{
+	// Define a scene
+	CScene scene;
+	BuildScene(scene);
+	if (calibrate) scene.calibrateAccelStructure();
 
-	for (int y = 0; y < img.rows; y++)
-		for (int x = 0; x < img.cols; x++) {
-			scene.getActiveCamera()->InitRay(ray, x, y);	// initialize ray
-			img.at<Vec3f>(y, x) = scene.RayTrace(ray);
-		}
+	Mat img = wavefront ? CRendererWavefront(scene).render() : CRendererImmediate(scene).render();
 	
 	img.convertTo(img, CV_8UC3, 255);
 	return img;
 }
 
+// Renders the torus knot scene with a render farm of nWorkers local (and any number of remote) worker processes
+Mat RenderFrameDistributed(int nWorkers, int port)
+{
+	Mat img = CRenderFarm(BuildScene).render(resolution, nWorkers, port);
+	img.convertTo(img, CV_8UC3, 255);
+	return img;
+}
+
+// Renders the torus knot, partitioned into the clusters in directory path (Ref. COutOfCoreMesh::partition()), with memory budget in megabytes
+Mat RenderFrameOutOfCore(const std::string& path, size_t budget)
+{
+	CScene scene;
+	scene.add(std::make_shared<CCameraPerspective>(resolution, Vec3f(0, 3.5f, -13), Vec3f(0, 0, 1), Vec3f(0, 1, 0), 60));
+	scene.buildAccelStructure();
+
+	COutOfCoreMesh mesh(std::make_shared<CShaderEyelight>(Vec3f::all(1)), path, budget << 20);
+	Mat img = CRendererOutOfCore(scene, mesh).render();
+	printf("%zu cluster loads for %zu clusters\n", mesh.getNumLoads(), mesh.getNumClusters());
+
+	img.convertTo(img, CV_8UC3, 255);
+	return img;
+}
+
+// Builds a scene with mirror and glass spheres
+void BuildReflectionScene(CScene& scene)
+{
+	scene.add(std::make_shared<CCameraPerspective>(resolution, Vec3f(0, 3.5f, -13), Vec3f(0, 0, 1), Vec3f(0, 1, 0), 60));
+	scene.add(std::make_shared<CLightOmni>(Vec3f::all(50), Vec3f(-3, 10, -8)));
+	scene.add(std::make_shared<CLightOmni>(Vec3f::all(30), Vec3f(5, 1, -6)));
+
+	scene.add(std::make_shared<CPrimSphere>(std::make_shared<CShaderMirror>(RGB(0.9f, 0.9f, 0.9f)), Vec3f(-2.5f, 3, 3), 2.5f));
+	scene.add(std::make_shared<CPrimSphere>(std::make_shared<CShaderMirror>(RGB(0.9f, 0.8f, 0.5f)), Vec3f(3, 2, 4), 2));
+	scene.add(std::make_shared<CPrimSphere>(std::make_shared<CShaderGlass>(RGB(0.95f, 1, 0.95f), 1.5f), Vec3f(0.5f, 2, -3), 1.5f));
+	RNG rng;
+	for (int i = 0; i < 24; i++) {
+		Vec3f color = RGB(rng.uniform(0.2f, 1.0f), rng.uniform(0.2f, 1.0f), rng.uniform(0.2f, 1.0f));
+		float a = 2 * Pif * i / 24;
+		scene.add(std::make_shared<CPrimSphere>(std::make_shared<CShaderPhong>(scene, color, 0.1f, 0.5f, 0.5f, 40), Vec3f(7 * cosf(a), 0.5f, 7 * sinf(a) + 2), 0.5f));
+	}
+	scene.buildAccelStructure();
+}
+
+// Builds a scene with many materials
+void BuildBenchmarkScene(CScene& scene, const Size& resolution)
+{
+	scene.add(std::make_shared<CCameraPerspective>(resolution, Vec3f(0, 3.5f, -13), Vec3f(0, 0, 1), Vec3f(0, 1, 0), 60));
+	scene.add(std::make_shared<CLightOmni>(Vec3f::all(50), Vec3f(-3, 10, -8)));
+	scene.add(std::make_shared<CLightOmni>(Vec3f::all(30), Vec3f(5, 1, -6)));
+
+	// A grid of spheres, each with its own material
+	RNG rng;
+	for (int j = 0; j < 12; j++)
+		for (int i = 0; i < 16; i++) {
+			Vec3f color = RGB(rng.uniform(0.2f, 1.0f), rng.uniform(0.2f, 1.0f), rng.uniform(0.2f, 1.0f));
+			ptr_shader_t pShader;
+			switch ((i + j) % 3) {
+				case 0: pShader = std::make_shared<CShaderFlat>(color); break;
+				case 1: pShader = std::make_shared<CShaderEyelight>(color); break;
+				default: pShader = std::make_shared<CShaderPhong>(scene, color, 0.1f, 0.5f, 0.5f, 40); break;
+			}
+			scene.add(std::make_shared<CPrimSphere>(pShader, Vec3f(i - 7.5f, j - 2.0f, 0), 0.45f));
+		}
+	scene.buildAccelStructure();
+}
+
+// Builds the torus knot scene with the Phong shading and many lights
+void BuildShadowBenchmarkScene(CScene& scene, const Size& resolution)
+{
+	scene.add(std::make_shared<CCameraPerspective>(resolution, Vec3f(0, 3.5f, -13), Vec3f(0, 0, 1), Vec3f(0, 1, 0), 60));
+#ifdef WIN32
+	const std::string dataPath = "../data/";
+#else
+	const std::string dataPath = "../../data/";
+#endif
+	CSolid solid(std::make_shared<CShaderPhong>(scene, Vec3f::all(1), 0.1f, 0.5f, 0.5f, 40), dataPath + "Torus Knot.obj");
+	scene.add(solid);
+	scene.buildAccelStructure();
+	for (int i = 0; i < 4; i++)
+		scene.add(std::make_shared<CLightOmni>(Vec3f::all(15), Vec3f(-6.0f + 4 * i, 10, (i % 2) ? 6.0f : -6.0f)));
+}
+
+// Builds a close-up view of the torus knot, which sees only a part of the mesh
+void BuildCloseUpScene(CScene& scene, const Size& resolution, bool lazy)
+{
+	scene.add(std::make_shared<CCameraPerspective>(resolution, Vec3f(1.5f, 1.0f, -4.5f), Vec3f(0, 0, 1), Vec3f(0, 1, 0), 30));
+#ifdef WIN32
+	const std::string dataPath = "../data/";
+#else
+	const std::string dataPath = "../../data/";
+#endif
+	CSolid solid(std::make_shared<CShaderEyelight>(Vec3f::all(1)), dataPath + "Torus Knot.obj");
+	scene.add(solid);
+	scene.buildAccelStructure(0, 0, lazy);
+}
+
+// Builds the torus knot scene, seen from far away, with the finest level of detail or with the level, chosen for the camera
+std::shared_ptr<CPrimMesh> BuildFarScene(CScene& scene, const Size& resolution, const CSolidLOD& solid, bool lod)
+{
+	scene.add(std::make_shared<CCameraPerspective>(resolution, Vec3f(0, 3.5f, -300), Vec3f(0, 0, 1), Vec3f(0, 1, 0), 60));
+	auto pMesh = solid.getPrim(lod ? solid.selectLevel(*scene.getActiveCamera()) : 0);
+	scene.add(pMesh);
+	scene.buildAccelStructure();
+	return pMesh;
+}
+
+// Renders a slow camera fly-through of the torus knot scene with the full and with the reprojected frames and compares them
+void FlyThrough(size_t nFrames = 30, float validationRate = 0.05f)
+{
+	CScene scene;
+	BuildScene(scene);
+	CRendererImmediate immediate(scene);
+	CRendererReprojection reprojection(scene, validationRate);
+	double fullTime = 0;
+	double reprojectionTime = 0;
+	double tracedFraction = 0;
+	double error = 0;
+	for (size_t f = 0; f < nFrames; f++) {
+		auto pCamera = std::make_shared<CCameraPerspective>(resolution, Vec3f(0.02f * f, 3.5f, 0.05f * f - 13), Vec3f(0, 0, 1), Vec3f(0, 1, 0), 60);
+		immediate.setCamera(pCamera);
+		reprojection.setCamera(pCamera);
+		int64 ticks = getTickCount();
+		Mat full = immediate.render();
+		const double t0 = 1000.0 * (getTickCount() - ticks) / getTickFrequency();
+		ticks = getTickCount();
+		Mat img = reprojection.render();
+		const double t1 = 1000.0 * (getTickCount() - ticks) / getTickFrequency();
+		if (f == 0) continue;		// the first frame is traced completely
+		fullTime += t0;
+		reprojectionTime += t1;
+		tracedFraction += reprojection.getTracedFraction();
+		for (int y = 0; y < img.rows; y++)
+			for (int x = 0; x < img.cols; x++)
+				for (int c = 0; c < 3; c++) error += fabsf(img.at<Vec3f>(y, x)[c] - full.at<Vec3f>(y, x)[c]);
+	}
+	const double n = static_cast<double>(MAX(size_t(1), nFrames - 1));
+	printf("Fly-through: %.1f ms per full frame, %.1f ms per reprojected frame (%.1f%% of the pixels traced, validation rate %.2f), mean error %.4f\n",
+		fullTime / n, reprojectionTime / n, 100 * tracedFraction / n, validationRate, error / (n * 3 * resolution.area()));
+}
+
+// Renders a scene with many materials with the immediate and the wavefront renderers, then the torus knot with and without
+// the shadow ray sorting, and reports their throughput. Then reports the time to the first frame of a close-up with the eager and the lazy BSP build.
+// Finally reports the frame time and the memory of a distant torus knot in the full detail and with the level of detail, and a camera fly-through with the temporal reprojection
+void Benchmark(void)
+{
+	const Size resolution(800, 600);
+	CScene scene;
+	BuildBenchmarkScene(scene, resolution);
+
+	const double nRays = resolution.area();
+	DirectGraphicalModels::Timer::start("Immediate mode... ");
+	CRendererImmediate(scene).render();
+	double t = DirectGraphicalModels::Timer::stop();
+	printf("Immediate mode: %.3f MRays/s\n", nRays / (1000 * t));
+
+	DirectGraphicalModels::Timer::start("Wavefront mode... ");
+	CRendererWavefront(scene).render();
+	t = DirectGraphicalModels::Timer::stop();
+	printf("Wavefront mode: %.3f MRays/s\n", nRays / (1000 * t));
+
+	// Shadow rays in the original and in the sorted order
+	CScene shadowScene;
+	BuildShadowBenchmarkScene(shadowScene, resolution);
+	for (int sortRays = 0; sortRays < 2; sortRays++) {
+		CPerfCounters::Counts before = CPerfCounters::getTotal(PerfStage::traversal);
+		DirectGraphicalModels::Timer::start(sortRays ? "Sorted shadow rays... " : "Unsorted shadow rays... ");
+		CRendererWavefront(shadowScene, Size(128, 128), sortRays != 0).render();
+		t = DirectGraphicalModels::Timer::stop();
+		CPerfCounters::Counts after = CPerfCounters::getTotal(PerfStage::traversal);
+		printf("%s shadow rays: %.3f MRays/s (primary)", sortRays ? "Sorted" : "Unsorted", nRays / (1000 * t));
+		if (CPerfCounters::getAvailability()[CPerfCounters::cacheMisses])
+			printf(", %llu traversal cache misses", static_cast<unsigned long long>(after.events[CPerfCounters::cacheMisses] - before.events[CPerfCounters::cacheMisses]));
+		printf("\n");
+	}
+
+	// Time to the first frame with the eager and the lazy BSP build, including loading of the mesh
+	for (int lazy = 0; lazy < 2; lazy++) {
+		CScene closeUpScene;
+		DirectGraphicalModels::Timer::start(lazy ? "Lazy BSP build... " : "Eager BSP build... ");
+		BuildCloseUpScene(closeUpScene, resolution, lazy != 0);
+		CRendererImmediate(closeUpScene).render();
+		t = DirectGraphicalModels::Timer::stop();
+		printf("%s BSP build: %.1f ms to the first frame, ", lazy ? "Lazy" : "Eager", t);
+		closeUpScene.printAccelStructureStats();
+	}
+
+	// A distant mesh in the full detail and with the level of detail
+#ifdef WIN32
+	const std::string dataPath = "../data/";
+#else
+	const std::string dataPath = "../../data/";
+#endif
+	CSolidLOD solid(std::make_shared<CShaderEyelight>(Vec3f::all(1)), dataPath + "Torus Knot.obj");
+	for (int lod = 0; lod < 2; lod++) {
+		CScene farScene;
+		auto pMesh = BuildFarScene(farScene, resolution, solid, lod != 0);
+		DirectGraphicalModels::Timer::start(lod ? "Distant mesh with LOD... " : "Distant mesh in full detail... ");
+		CRendererImmediate(farScene).render();
+		t = DirectGraphicalModels::Timer::stop();
+		printf("Distant mesh %s: %.1f ms, %zu triangles, %zu kB\n", lod ? "with LOD" : "in full detail", t, pMesh->getNumTriangles(), pMesh->getMemoryUsage() >> 10);
+	}
+
+	// A slow camera fly-through with the temporal reprojection
+	FlyThrough();
+}
+
+// Renders the torus knot scene with the wavefront renderer and reports the hardware performance counters per render stage
+void Profile(const std::string& reportFileName)
+{
+#ifndef ENABLE_PERF_COUNTERS
+	printf("Warning: Profiling support is not enabled, %s is not written!\n", reportFileName.c_str());
+#else
+	RenderFrame(true);
+	CPerfCounters::printSummary();
+	if (CPerfCounters::writeReport(reportFileName))
+		printf("Profiling report is written to %s\n", reportFileName.c_str());
+	else
+		printf("ERROR: Can't write the profiling report %s\n", reportFileName.c_str());
+#endif
+}
+
+// Returns the FNV-1a hash of the image pixels
+qword HashImage(const Mat& img)
+{
+	qword res = 0xCBF29CE484222325ULL;
+	for (int y = 0; y < img.rows; y++) {
+		const byte* pRow = img.ptr<byte>(y);
+		for (size_t i = 0; i < img.cols * img.elemSize(); i++)
+			res = (res ^ pRow[i]) * 0x100000001B3ULL;
+	}
+	return res;
+}
+
+// Renders the benchmark scene with stochastic light sampling using different numbers of threads and compares the image hashes
+bool Verify(void)
+{
+	const Size resolution(400, 300);
+	CScene scene;
+	BuildBenchmarkScene(scene, resolution);
+	scene.buildLightStructure(1);
+
+	bool res = true;
+	const int nThreads = MAX(4, static_cast<int>(std::thread::hardware_concurrency()));
+	for (int wavefront = 0; wavefront < 2; wavefront++) {
+		std::optional<qword> reference;
+		for (int n = 1; ; n = MIN(2 * n, nThreads)) {
+			setNumThreads(n);
+			qword hash = HashImage(wavefront ? CRendererWavefront(scene).render() : CRendererImmediate(scene).render());
+			printf("%s mode, %2d thread(s): %016llx\n", wavefront ? "Wavefront" : "Immediate", n, static_cast<unsigned long long>(hash));
+			if (!reference) reference = hash;
+			else if (hash != reference.value()) res = false;
+			if (n == nThreads) break;
+		}
+	}
+	setNumThreads(-1);
+	printf(res ? "Verification passed\n" : "Verification FAILED: the images differ\n");
+	return res;
+}
+
+// Requests the scene named scene from the render server on socket socketPath, seen by the camera of the torus knot scene
+Mat RenderFrameOnServer(const std::string& socketPath, const std::string& scene, int priority, int samples)
+{
+	CRenderServer::Request request;
+	strncpy(request.scene, scene.c_str(), sizeof(request.scene) - 1);
+	request.pos[1] = 3.5f;
+	request.pos[2] = -13;
+	request.width = resolution.width;
+	request.height = resolution.height;
+	request.samples = samples;
+	request.priority = priority;
+	Mat img = CRenderServer::request(socketPath, request);
+	if (!img.empty()) img.convertTo(img, CV_8UC3, 255);
+	return img;
+}
+
 int main(int argc, char* argv[])
 {
+	// --trace <file> may precede any mode; the trace is written, when main() returns
+	std::string traceFileName;
+	if (argc > 2 && std::string(argv[1]) == "--trace") {
+		traceFileName = argv[2];
+		argc -= 2;
+		argv += 2;
+	}
+	CTraceFile traceFile(traceFileName);
+	// --numa <replicate|interleave> [nodes] may precede any mode; the number of nodes emulates more nodes than the machine has
+	if (argc > 2 && std::string(argv[1]) == "--numa") {
+		const std::string numaMode = argv[2];
+		const size_t nNodes = argc > 3 && isdigit(argv[3][0]) ? static_cast<size_t>(atoi(argv[3])) : 0;
+		CNuma::init(numaMode == "interleave" ? NumaMode::interleave : numaMode == "replicate" ? NumaMode::replicate : NumaMode::off, nNodes);
+		argc -= nNodes ? 3 : 2;
+		argv += nNodes ? 3 : 2;
+	}
+	std::string mode = argc > 1 ? argv[1] : "";
+	if (mode == "--benchmark") {
+		Benchmark();
+		return 0;
+	}
+	if (mode == "--profile") {
+		Profile(argc > 2 ? argv[2] : "profile.json");
+		return 0;
+	}
+	if (mode == "--flythrough") {
+		FlyThrough(argc > 2 ? atoi(argv[2]) : 30, argc > 3 ? static_cast<float>(atof(argv[3])) : 0.05f);
+		return 0;
+	}
+	if (mode == "--verify")
+		return Verify() ? 0 : 1;
+	if (mode == "--partition" && argc > 3)
+		return COutOfCoreMesh::partition(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 65536, 8) ? 0 : 1;
+	if (mode == "--worker" && argc > 3) {
+		CRenderFarm::work(BuildScene, argv[2], atoi(argv[3]));
+		return 0;
+	}
+	const std::string socketPath = argc > 2 ? argv[2] : "/tmp/raytracer.sock";
+	if (mode == "--server")
+		return CRenderServer({ { "torus", BuildScene }, { "reflections", BuildReflectionScene } }).serve(socketPath) ? 0 : 1;
+	if (mode == "--shutdown") {
+		CRenderServer::request(socketPath, CRenderServer::Request{});
+		return 0;
+	}
+
 	DirectGraphicalModels::Timer::start("Rendering frame... ");
-	Mat img = RenderFrame();
+	Mat img;
+	if (mode == "--farm") img = RenderFrameDistributed(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 0);
+	else if (mode == "--reflections") {
+		CScene scene;
+		BuildReflectionScene(scene);
+		img = CRendererImmediate(scene).render();
+		img.convertTo(img, CV_8UC3, 255);
+	}
+	else if (mode == "--ooc" && argc > 2) img = RenderFrameOutOfCore(argv[2], argc > 3 ? atoi(argv[3]) : 256);
+	else if (mode == "--request" && argc > 3) {
+		img = RenderFrameOnServer(socketPath, argv[3], argc > 4 ? atoi(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 1);
+		if (img.empty()) return 1;
+	}
+	else img = RenderFrame(mode == "--wavefront", mode == "--calibrate");
 	DirectGraphicalModels::Timer::stop();
+	CNuma::printSummary();
+	{
+		TRACE_SCOPE("image write");
+		imwrite("D:/renders/torus knot.jpg", img);
+	}
 	imshow("Image", img);
 	waitKey();
-	imwrite("D:/renders/torus knot.jpg", img);
 	return 0;
 }
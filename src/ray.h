@@ -9,8 +9,87 @@ class CPrim;
 /// Basic ray structure
 struct Ray
 {
-	Vec3f							org;											///< Origin
-	Vec3f							dir;											///< Direction
-	double							t = std::numeric_limits<double>::infinity();	///< Current/maximum hit distance
+	Vec3fa							org;											///< Origin
+	Vec3fa							dir;											///< Direction
+	float							t = std::numeric_limits<float>::infinity();		///< Current/maximum hit distance
 	std::shared_ptr<const IPrim>	hit = nullptr;									///< Pointer to currently closest primitive
 };
+
+/**
+ * @brief Offsets the origin of a ray, spawned from a surface
+ * @details The hit point \b p, calculated from the ray distance, lies on either side of the surface within an error, which grows with
+ * the magnitude of its coordinates. The point is moved along the normal by a few units in the last place of every coordinate, which
+ * bounds that error; the coordinates close to zero, where the units in the last place vanish, are moved by a small constant instead
+ * (Ref. C. Waechter, N. Binder: A Fast and Robust Method for Avoiding Self-Intersection, Ray Tracing Gems, 2019).
+ * Since the offset is scaled to the hit point, neither the near nor the distant surfaces need a global epsilon
+ * @param p The hit point
+ * @param n The normal of the surface, pointing to the side, where the new ray goes to
+ * @returns The origin of the new ray
+ */
+inline Vec3fa offsetRayOrigin(const Vec3fa& p, const Vec3fa& n)
+{
+	const float origin		= 1.0f / 32;		// the coordinates below are offset by a constant
+	const float floatScale	= 1.0f / 65536;		// the constant offset
+	const float intScale	= 256;				// the offset in units in the last place
+
+	Vec3fa res;
+	for (int i = 0; i < 3; i++) {
+		int32_t bits;
+		memcpy(&bits, &p.val[i], sizeof(float));
+		int32_t ulps = static_cast<int32_t>(intScale * n.val[i]);
+		bits += p.val[i] < 0 ? -ulps : ulps;
+		float offset;
+		memcpy(&offset, &bits, sizeof(float));
+		res.val[i] = fabsf(p.val[i]) < origin ? p.val[i] + floatScale * n.val[i] : offset;
+	}
+	return res;
+}
+
+/// Shadow ray, whose visibility test is deferred (Ref. @ref IShader::shadeDeferred())
+struct ShadowRay
+{
+	Ray								ray;											///< The ray from the shading point towards the light source
+	Vec3f							contribution;									///< The contribution to be added, if \b ray is not occluded
+	size_t							index;											///< The index of the shading point, the contribution is to be added to
+};
+
+/// Secondary (reflected or refracted) ray, spawned by a shader (Ref. @ref IShader::scatter())
+struct SecondaryRay
+{
+	Ray								ray;											///< The ray from the hit point
+	Vec3f							weight;											///< The factor, the color seen along \b ray is to be multiplied with
+};
+
+/// Batch of rays in the structure-of-arrays layout, generated by a camera (Ref. @ref ICamera::InitRays())
+struct RayBatch
+{
+	std::vector<float>				orgX, orgY, orgZ;								///< Origins
+	std::vector<float>				dirX, dirY, dirZ;								///< Normalized directions
+
+	/**
+	 * @brief Resizes the batch
+	 * @param n The number of rays
+	 */
+	void resize(size_t n)
+	{
+		for (auto pv : { &orgX, &orgY, &orgZ, &dirX, &dirY, &dirZ })
+			pv->resize(n);
+	}
+	/**
+	 * @brief Returns the number of rays in the batch
+	 * @return The number of rays
+	 */
+	size_t size(void) const { return dirX.size(); }
+	/**
+	 * @brief Initializes the ray \b ray with the ray of the batch with index \b i
+	 * @param i The index of the ray in the batch
+	 * @param[out] ray The ray with no hit and infinite maximum distance
+	 */
+	void getRay(size_t i, Ray& ray) const
+	{
+		ray.org = Vec3fa(orgX[i], orgY[i], orgZ[i]);
+		ray.dir = Vec3fa(dirX[i], dirY[i], dirZ[i]);
+		ray.t = std::numeric_limits<float>::infinity();
+		ray.hit = nullptr;
+	}
+};
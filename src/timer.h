@@ -27,10 +27,12 @@ namespace DirectGraphicalModels
 		/**
 		* @brief Stops the timer
 		* @details This function prints out the time in milliseconds passed between start() and stop()
+		* @returns The time in milliseconds passed between start() and stop()
 		*/
-		void stop(void) 
+		double stop(void) 
 		{
-			int64 ms = static_cast<int64>(1000 * (getTickCount() - m_ticks) / getTickFrequency());
+			double res = 1000 * (getTickCount() - m_ticks) / getTickFrequency();
+			int64 ms = static_cast<int64>(res);
 			int64 sec = 0;
 			int64 min = 0;
 			int64 hrs = 0;
@@ -53,6 +55,7 @@ namespace DirectGraphicalModels
 			if (min) printf("%lld:", min);
 			if (sec) printf("%lld'", sec);
 			printf("%03lld ms)\n", ms);
+			return res;
 		}
 	}
 }
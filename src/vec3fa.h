@@ -0,0 +1,143 @@
+// Aligned 3D vector structure
+#pragma once
+
+#include "types.h"
+#if defined(ENABLE_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VEC3FA_SSE
+#include <emmintrin.h>
+#endif
+
+// ================================ Aligned Vector Structure ================================
+/**
+ * @brief Aligned 3D vector structure
+ * @details The vector occupies 16 bytes: the 3 coordinates are followed by a padding element, which is always zero.
+ * Thus a vector is loaded into one SSE register and the arithmetic, the dot and the cross products take a few instructions each.
+ * If ENABLE_SIMD is not defined or the target has no SSE2, the scalar implementation is used.
+ * The vector is used in the ray tracing core (rays, triangles and bounding boxes) and converts implicitly from and to Vec3f,
+ * which remains the vector type of the rest of the code
+ */
+struct alignas(16) Vec3fa
+{
+	float val[4];		///< The coordinates and the padding element
+
+	Vec3fa(void) : val{ 0, 0, 0, 0 } {}
+	Vec3fa(float x, float y, float z) : val{ x, y, z, 0 } {}
+	Vec3fa(const Vec3f& v) : val{ v.val[0], v.val[1], v.val[2], 0 } {}
+	operator Vec3f(void) const { return Vec3f(val[0], val[1], val[2]); }
+
+	/**
+	 * @brief Returns the vector with all the coordinates equal to \b a
+	 * @param a The value of the coordinates
+	 * @returns The vector (a, a, a)
+	 */
+	static Vec3fa all(float a) { return Vec3fa(a, a, a); }
+
+	float& operator[](int i) { return val[i]; }
+	float operator[](int i) const { return val[i]; }
+
+#ifdef VEC3FA_SSE
+	explicit Vec3fa(__m128 m) { _mm_store_ps(val, m); }
+	__m128 m128(void) const { return _mm_load_ps(val); }
+
+	Vec3fa& operator+=(const Vec3fa& v) { _mm_store_ps(val, _mm_add_ps(m128(), v.m128())); return *this; }
+	Vec3fa& operator-=(const Vec3fa& v) { _mm_store_ps(val, _mm_sub_ps(m128(), v.m128())); return *this; }
+	Vec3fa& operator*=(float a) { _mm_store_ps(val, _mm_mul_ps(m128(), _mm_set1_ps(a))); return *this; }
+	Vec3fa operator-(void) const { return Vec3fa(_mm_sub_ps(_mm_setzero_ps(), m128())); }
+	/**
+	 * @brief Calculates the dot product
+	 * @param v The second vector
+	 * @returns The dot product of the vectors
+	 */
+	float dot(const Vec3fa& v) const
+	{
+		__m128 m = _mm_mul_ps(m128(), v.m128());
+		__m128 y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 z = _mm_movehl_ps(m, m);
+		return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(m, y), z));
+	}
+	/**
+	 * @brief Calculates the cross product
+	 * @param v The second vector
+	 * @returns The cross product of the vectors
+	 */
+	Vec3fa cross(const Vec3fa& v) const
+	{
+		__m128 a = m128();
+		__m128 b = v.m128();
+		__m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYZX), _mm_mul_ps(aYZX, b));		// the cross product in (z, x, y) order
+		return Vec3fa(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+	}
+	/**
+	 * @brief Multiplies the vectors element-wise
+	 * @param v The second vector
+	 * @returns The element-wise product of the vectors
+	 */
+	Vec3fa mul(const Vec3fa& v) const { return Vec3fa(_mm_mul_ps(m128(), v.m128())); }
+#else
+	Vec3fa& operator+=(const Vec3fa& v) { for (int i = 0; i < 3; i++) val[i] += v.val[i]; return *this; }
+	Vec3fa& operator-=(const Vec3fa& v) { for (int i = 0; i < 3; i++) val[i] -= v.val[i]; return *this; }
+	Vec3fa& operator*=(float a) { for (int i = 0; i < 3; i++) val[i] *= a; return *this; }
+	Vec3fa operator-(void) const { return Vec3fa(-val[0], -val[1], -val[2]); }
+	float dot(const Vec3fa& v) const { return val[0] * v.val[0] + val[1] * v.val[1] + val[2] * v.val[2]; }
+	Vec3fa cross(const Vec3fa& v) const
+	{
+		return Vec3fa(val[1] * v.val[2] - val[2] * v.val[1], val[2] * v.val[0] - val[0] * v.val[2], val[0] * v.val[1] - val[1] * v.val[0]);
+	}
+	Vec3fa mul(const Vec3fa& v) const { return Vec3fa(val[0] * v.val[0], val[1] * v.val[1], val[2] * v.val[2]); }
+#endif
+};
+
+inline Vec3fa operator+(Vec3fa a, const Vec3fa& b) { return a += b; }
+inline Vec3fa operator-(Vec3fa a, const Vec3fa& b) { return a -= b; }
+inline Vec3fa operator*(Vec3fa a, float s) { return a *= s; }
+inline Vec3fa operator*(float s, Vec3fa a) { return a *= s; }
+inline Vec3fa operator/(Vec3fa a, float s) { return a *= 1.0f / s; }
+
+/**
+ * @brief Calculates the Euclidean length of the vector
+ * @param v The vector
+ * @returns The length of \b v
+ */
+inline float norm(const Vec3fa& v) { return sqrtf(v.dot(v)); }
+/**
+ * @brief Normalizes the vector
+ * @param v The vector
+ * @returns The vector of unit length, pointing in the direction of \b v, or \b v if it is zero
+ */
+inline Vec3fa normalize(const Vec3fa& v)
+{
+	float l = norm(v);
+	return l > 0 ? v * (1.0f / l) : v;
+}
+/**
+ * @brief Calculates the element-wise minimum of the vectors
+ * @param a The first vector
+ * @param b The second vector
+ * @returns The vector of the smaller coordinates
+ */
+inline Vec3fa Min3f(const Vec3fa& a, const Vec3fa& b)
+{
+#ifdef VEC3FA_SSE
+	return Vec3fa(_mm_min_ps(a.m128(), b.m128()));
+#else
+	return Vec3fa(MIN(a.val[0], b.val[0]), MIN(a.val[1], b.val[1]), MIN(a.val[2], b.val[2]));
+#endif
+}
+/**
+ * @brief Calculates the element-wise maximum of the vectors
+ * @param a The first vector
+ * @param b The second vector
+ * @returns The vector of the larger coordinates
+ */
+inline Vec3fa Max3f(const Vec3fa& a, const Vec3fa& b)
+{
+#ifdef VEC3FA_SSE
+	return Vec3fa(_mm_max_ps(a.m128(), b.m128()));
+#else
+	return Vec3fa(MAX(a.val[0], b.val[0]), MAX(a.val[1], b.val[1]), MAX(a.val[2], b.val[2]));
+#endif
+}
+
+inline std::ostream& operator<<(std::ostream& os, const Vec3fa& v) { return os << static_cast<Vec3f>(v); }